@@ -0,0 +1,114 @@
+// 量測每個請求在 middleware 裡配置幾次記憶體（全域 operator new 計數）
+//
+//   cmake -S . -B build -DTP_BUILD_BENCH=ON && cmake --build build
+//   ./build/middleware_alloc_bench [iterations]
+//
+// 情境：
+//   whitelisted   白名單路由，不帶 token
+//   cached-token  帶 Bearer token，第一次驗證後命中 TokenCache
+//   cors-origin   瀏覽器請求（帶 Origin），Cors 需要寫三個 header
+//
+// 每個請求都會多一個 Vary: Origin（header map 的節點 + bucket 陣列）
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "crow_all.h"
+#include "app/middleware.hpp"
+
+namespace {
+    std::atomic<std::uint64_t> g_allocs{0};
+}
+
+void* operator new(std::size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+    struct Result
+    {
+        double allocsPerReq;
+        double nsPerReq;
+    };
+
+    // 每輪都用新的 response / context，跟 Crow 每個連線的處理方式一致
+    template <typename Fn>
+    Result run(int iters, Fn&& once) {
+        once(); // 暖身：第一次驗證、static 初始化
+        const std::uint64_t before = g_allocs.load();
+        const auto          t0     = std::chrono::steady_clock::now();
+        for (int i = 0; i < iters; ++i) once();
+        const auto          t1    = std::chrono::steady_clock::now();
+        const std::uint64_t after = g_allocs.load();
+        const double        ns =
+            std::chrono::duration<double, std::nano>(t1 - t0).count();
+        return {double(after - before) / iters, ns / iters};
+    }
+
+    void report(const char* name, const Result& r) {
+        std::printf("%-14s %8.2f allocs/req %10.1f ns/req\n", name, r.allocsPerReq,
+                    r.nsPerReq);
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int iters = argc > 1 ? std::atoi(argv[1]) : 200000;
+    setenv("AUTH_JWT_SECRET", "bench-secret", 0);
+    setenv("AUTH_JWT_ISSUER", "taskplanet", 0);
+
+    Cors          cors;
+    JwtMiddleware jwtMw;
+
+    const std::string token =
+        jwt::create()
+            .set_issuer("taskplanet")
+            .set_subject("bench-user")
+            .set_payload_claim("role", jwt::claim(std::string("user")))
+            .set_expires_at(std::chrono::system_clock::now() +
+                            std::chrono::hours(1))
+            .sign(jwt::algorithm::hs256{"bench-secret"});
+
+    crow::request open;
+    open.method = crow::HTTPMethod::Get;
+    open.url    = "/api/suggest";
+
+    crow::request authed;
+    authed.method = crow::HTTPMethod::Post;
+    authed.url    = "/api/events";
+    authed.add_header("Authorization", "Bearer " + token);
+
+    crow::request browser = authed;
+    browser.add_header("Origin", "https://taskplanet.app");
+
+    auto through = [&](crow::request& req) {
+        crow::response         res;
+        Cors::context          corsCtx;
+        JwtMiddleware::context jwtCtx;
+        cors.before_handle(req, res, corsCtx);
+        jwtMw.before_handle(req, res, jwtCtx);
+        cors.after_handle(req, res, corsCtx);
+        if (!jwtCtx.jwt.authenticated && req.url != "/api/suggest")
+            std::abort(); // token 沒過驗證，數字沒有意義
+    };
+
+    std::printf("iterations: %d\n", iters);
+    report("whitelisted", run(iters, [&] { through(open); }));
+    report("cached-token", run(iters, [&] { through(authed); }));
+    report("cors-origin", run(iters, [&] { through(browser); }));
+
+    if (auto const* c = jwtMw.token_cache()) {
+        const auto st = c->stats();
+        std::printf("token cache: hits=%llu misses=%llu\n",
+                    (unsigned long long)st.hits, (unsigned long long)st.misses);
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+// 事件持續寫入時 /api/suggest 結果快取的命中率：全域失效 vs 依 tag 失效
+//
+//   cmake -S . -B build -DTP_BUILD_BENCH=ON && cmake --build build
+//   ./build/recommend_cache_hit_bench [reads] [readsPerEvent]
+//
+// 查詢與事件的 tag 都依 Zipf 分佈挑（熱門 tag 同時被查得多、寫得多），
+// 每 readsPerEvent 次查詢穿插一個事件（每個事件 1~4 個 tag）。ttl = 0，
+// 只看寫入造成的失效。
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "cache/recommend_cache.hpp"
+
+namespace {
+
+    constexpr int kTags     = 120; // tag_dim 大小
+    constexpr int kTagSets  = 600; // 不同的查詢組合
+    constexpr int kTimeStep = 15;
+
+    // P(rank) ∝ 1 / rank^s
+    std::discrete_distribution<int> zipf(int n, double s) {
+        std::vector<double> w(n);
+        for (int i = 0; i < n; ++i) w[i] = 1.0 / std::pow(i + 1, s);
+        return {w.begin(), w.end()};
+    }
+
+    struct Query
+    {
+        std::vector<int> tags;
+        int              time;
+    };
+
+    double run(bool perTag, int reads, int readsPerEvent) {
+        std::mt19937 rng(42);
+        auto         tagDist = zipf(kTags, 1.1);
+        auto         setDist = zipf(kTagSets, 1.0);
+
+        std::vector<Query> queries(kTagSets);
+        for (auto& q : queries) {
+            const int n = 1 + static_cast<int>(rng() % 3);
+            for (int i = 0; i < n; ++i) q.tags.push_back(1 + tagDist(rng));
+            q.time = kTimeStep * static_cast<int>(1 + rng() % 8);
+        }
+
+        RecommendCache::Options opt;
+        opt.ttl = std::chrono::milliseconds(0);
+        RecommendCache cache(opt);
+        auto           compute = [] { return RecommendCache::Items(10); };
+
+        for (int i = 0; i < reads; ++i) {
+            const Query& q = queries[setDist(rng)];
+            cache.get_or_compute(cache.make_key(TagSet::of(q.tags), q.time, 10),
+                                 compute);
+            if (i % readsPerEvent != 0)
+                continue;
+            std::vector<WeightDelta> ds;
+            const int                n = 1 + static_cast<int>(rng() % 4);
+            for (int t = 0; t < n; ++t)
+                ds.push_back({1 + static_cast<int>(rng() % 5000),
+                              1 + tagDist(rng),
+                              0.0,
+                              1.0});
+            if (perTag)
+                cache.apply(ds);
+            else
+                cache.invalidate(); // 修正前：任何寫入都清掉整個快取
+        }
+        const auto st = cache.stats();
+        return static_cast<double>(st.hits) / double(st.hits + st.misses);
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int reads         = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const int readsPerEvent = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+    std::printf("reads: %d, one event every %d reads\n", reads, readsPerEvent);
+    std::printf("global generation  hit ratio %6.2f%%\n",
+                100.0 * run(false, reads, readsPerEvent));
+    std::printf("per-tag generation hit ratio %6.2f%%\n",
+                100.0 * run(true, reads, readsPerEvent));
+    return 0;
+}
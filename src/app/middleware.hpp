@@ -1,39 +1,310 @@
 #pragma once
 #include "crow_all.h"
 #include <jwt-cpp/jwt.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "../config/config.hpp"
+#include "../cache/token_cache.hpp"
+#include "../util/metrics.hpp"
+#include "../util/rate_limiter.hpp"
+
+// header 名稱只建一次（get_header_value 吃 const std::string&）
+namespace hdr {
+    inline const std::string& authorization() {
+        static const std::string k = "Authorization";
+        return k;
+    }
+    inline const std::string& origin() {
+        static const std::string k = "Origin";
+        return k;
+    }
+    inline const std::string& forwarded_for() {
+        static const std::string k = "X-Forwarded-For";
+        return k;
+    }
+    inline const std::string& vary() {
+        static const std::string k = "Vary";
+        return k;
+    }
+} // namespace hdr
+
+// "Bearer <token>" 的 token 部分（指向 header 本身）；格式不符時為空
+inline std::string_view bearer_token(const crow::request& req) {
+    const std::string& auth = req.get_header_value(hdr::authorization());
+    if (auth.size() < 8 || auth.compare(0, 7, "Bearer ") != 0)
+        return {};
+    return std::string_view(auth).substr(7);
+}
+
+// ---- Request metrics ----
+/// Latency and status class per route, first in the middleware chain so
+/// requests rejected by a later middleware (429, 401, CORS preflight) count too
+/// - routes are registered with add_route() before the server starts (through
+///   TP_ROUTE, so the label is the url the route was registered with); the
+///   table is read-only afterwards, so the lookup is a plain hash find
+/// - paths that were never registered (404s, scanners) share the "other" route
+///   instead of creating a series each
+class RequestMetrics
+{
+   public:
+    struct Route
+    {
+        std::string  path;
+        HdrHistogram latency;
+    };
+
+    struct context
+    {
+        Route*                                route = nullptr;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    RequestMetrics() : other_(std::make_unique<Route>()) { other_->path = "other"; }
+
+    // 只能在 app.run() 之前呼叫
+    void add_route(std::string path) {
+        if (byPath_.count(path))
+            return;
+        routes_.push_back(std::make_unique<Route>());
+        routes_.back()->path = path;
+        byPath_.emplace(std::move(path), routes_.back().get());
+    }
+
+    void before_handle(crow::request& req, crow::response&, context& ctx) {
+        auto it   = byPath_.find(req.url);
+        ctx.route = it != byPath_.end() ? it->second : other_.get();
+        ctx.start = std::chrono::steady_clock::now();
+    }
+
+    void after_handle(crow::request&, crow::response& res, context& ctx) {
+        if (ctx.route)
+            ctx.route->latency.record(std::chrono::steady_clock::now() - ctx.start,
+                                      res.code);
+    }
+
+    // fn(const Route&)，含 "other"
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (auto const& r : routes_) fn(*r);
+        fn(*other_);
+    }
+
+   private:
+    std::vector<std::unique_ptr<Route>>     routes_;
+    std::unordered_map<std::string, Route*> byPath_;
+    std::unique_ptr<Route>                  other_;
+};
+
+// CROW_ROUTE 並登記到 RequestMetrics：/metrics 的 route 標籤就取自註冊的 url
+#define TP_ROUTE(app, url)                                                 \
+    ((app).template get_middleware<RequestMetrics>().add_route(url),       \
+     CROW_ROUTE(app, url))
 
 // ---- 既有：CORS ----
+/// CORS headers only on browser requests (those carrying Origin)
+/// - app and server-to-server calls skip the three header strings
+/// - every response carries `Vary: Origin`, so a shared cache never hands a
+///   response without the CORS headers to a browser (or the other way round)
+/// - headers go on in after_handle: a handler's returned response replaces
+///   whatever before_handle wrote; preflight is still answered in before_handle
 struct Cors
 {
     struct context
     {
     };
     void before_handle(crow::request& req, crow::response& res, context&) {
+        // 預檢請求直接通過（避免卡在後續驗證）
+        if (req.method == crow::HTTPMethod::Options) {
+            res.code = 204;
+            res.end();
+        }
+    }
+    void after_handle(crow::request& req, crow::response& res, context&) {
+        res.add_header(hdr::vary(), hdr::origin()); // 兩者都在 SSO 內，不配置字串
+        if (req.get_header_value(hdr::origin()).empty())
+            return;
         res.add_header("Access-Control-Allow-Origin", "*");
         res.add_header("Access-Control-Allow-Headers",
                        "Content-Type, Authorization");
         res.add_header("Access-Control-Allow-Methods",
                        "GET,POST,PUT,PATCH,DELETE,OPTIONS");
-        // 預檢請求直接通過（避免卡在後續驗證）
-        if (req.method == crow::HTTPMethod::Options) {
-            res.code = 204;
-            res.end();
+    }
+};
+
+// ---- Rate limit ----
+/// Per-token and per-IP limits on the write endpoints (POST only)
+/// - runs after Cors and before JwtMiddleware, so a rejected request never
+///   reaches JWT verification or a handler that would borrow a DB connection
+/// - /api/events: VOTE_PER_MIN_PER_TOKEN and VOTE_PER_MIN_PER_IP
+/// - /api/suggestions/buffer: SUGGEST_PER_DAY_PER_TOKEN (when a bearer token
+///   is sent) and GUEST_ISSUE_PER_MIN_PER_IP
+/// - the token is not verified yet: a made-up token only gets its own bucket,
+///   the per-IP limit still applies
+/// - rejected requests get 429 with Retry-After (seconds)
+/// - behind proxies (RATE_LIMIT_TRUST_PROXY) the client IP is read from the
+///   right of X-Forwarded-For, skipping RATE_LIMIT_PROXY_HOPS - 1 entries that
+///   our own proxies appended; everything left of it is client-supplied
+class RateLimit
+{
+   public:
+    struct context
+    {
+    };
+
+    struct Rule
+    {
+        std::string                  path;
+        std::unique_ptr<RateLimiter> perToken; // nullptr = 不限
+        std::unique_ptr<RateLimiter> perIp;
+    };
+
+    RateLimit()
+        : proxyHops_(Config::rateLimitTrustProxy() ? Config::rateLimitProxyHops()
+                                                   : 0) {
+        if (!Config::rateLimitEnabled())
+            return;
+        using std::chrono::hours;
+        using std::chrono::minutes;
+        const auto slots = static_cast<std::size_t>(Config::rateLimitSlots());
+        auto make = [slots](int limit, std::chrono::milliseconds period) {
+            return limit > 0 ? std::make_unique<RateLimiter>(
+                                   static_cast<std::uint32_t>(limit), period, slots)
+                             : nullptr;
+        };
+        add("/api/events",
+            make(Config::votePerMinPerToken(), minutes(1)),
+            make(Config::votePerMinPerIP(), minutes(1)));
+        add("/api/suggestions/buffer",
+            make(Config::suggestPerDayPerToken(), hours(24)),
+            make(Config::guestIssuePerMinPerIP(), minutes(1)));
+#ifdef TP_ENABLE_DEV_LOGIN
+        add("/api/auth/dev-login",
+            nullptr,
+            make(Config::guestIssuePerMinPerIP(), minutes(1)));
+#endif
+    }
+
+    void before_handle(crow::request& req, crow::response& res, context&) {
+        if (req.method != crow::HTTPMethod::Post)
+            return;
+        const Rule* rule = find(req.url);
+        if (!rule)
+            return;
+        if (rule->perIp && !admit(*rule->perIp, client_ip(req), res))
+            return;
+        if (rule->perToken) {
+            const std::string_view token = bearer_token(req);
+            if (!token.empty())
+                admit(*rule->perToken, token, res);
         }
     }
+
     void after_handle(crow::request&, crow::response&, context&) {}
+
+    // 規則與各自的計數（RATE_LIMIT_ENABLED=false 時為空）
+    const std::vector<Rule>& rules() const { return rules_; }
+
+   private:
+    std::vector<Rule> rules_;
+    int               proxyHops_; // 0 = 不信任 X-Forwarded-For
+
+    void add(std::string                  path,
+             std::unique_ptr<RateLimiter> perToken,
+             std::unique_ptr<RateLimiter> perIp) {
+        if (perToken || perIp)
+            rules_.push_back(
+                {std::move(path), std::move(perToken), std::move(perIp)});
+    }
+
+    const Rule* find(const std::string& path) const {
+        for (auto const& r : rules_)
+            if (r.path == path)
+                return &r;
+        return nullptr;
+    }
+
+    std::string_view client_ip(const crow::request& req) const {
+        if (proxyHops_ > 0) {
+            // 代理是「附加」到尾端：從右邊數第 proxyHops_ 段才是最外層代理看到的
+            // 對端；更左邊的由 client 自己填，不能拿來當 key
+            std::string_view rest = req.get_header_value(hdr::forwarded_for());
+            for (int hop = 1; !rest.empty(); ++hop) {
+                const auto       comma = rest.rfind(',');
+                std::string_view ip    = comma == std::string_view::npos
+                                             ? rest
+                                             : rest.substr(comma + 1);
+                rest = rest.substr(0, comma == std::string_view::npos ? 0 : comma);
+                if (hop < proxyHops_)
+                    continue;
+                while (!ip.empty() && ip.back() == ' ') ip.remove_suffix(1);
+                while (!ip.empty() && ip.front() == ' ') ip.remove_prefix(1);
+                if (!ip.empty())
+                    return ip;
+                break;
+            }
+        }
+        return req.remote_ip_address; // 段數不足（沒經過全部代理）時用對端位址
+    }
+
+    static bool admit(RateLimiter&     limiter,
+                      std::string_view key,
+                      crow::response&  res) {
+        const auto d = limiter.acquire(key);
+        if (d.allowed)
+            return true;
+        res.code = 429;
+        res.set_header("Content-Type", "application/json");
+        res.set_header("Retry-After", std::to_string((d.retryAfterMs + 999) / 1000));
+        res.write(R"({"error":"rate_limited","hint":"Too many requests; )"
+                  R"(retry after Retry-After seconds."})");
+        res.end();
+        return false;
+    }
 };
 
 // ---- 新增：JWT ----
+// 數值越大權限越高；Unknown 低於所有角色（任何 requiresRoleOr403 都擋下）
+enum class Role : std::int8_t
+{
+    Unknown = -1,
+    Guest   = 0,
+    User    = 1,
+    Admin   = 2
+};
+
+// token 的 role claim；沒給時視為 user
+inline Role parse_role(std::string_view r) {
+    if (r.empty() || r == "user")
+        return Role::User;
+    if (r == "guest")
+        return Role::Guest;
+    if (r == "admin")
+        return Role::Admin;
+    return Role::Unknown;
+}
+
 struct JwtContext
 {
-    bool        authenticated = false;
-    std::string sub;
-    std::string role; // guest | user | admin
+    bool authenticated = false;
+    Role role          = Role::Guest;
+    // 與 token 快取共用；命中時只複製指標，不複製字串
+    std::shared_ptr<const std::string> subject;
+
+    const std::string& sub() const {
+        static const std::string none;
+        return subject ? *subject : none;
+    }
 };
 
+// verifier 在建構時建好一次（HS256 + issuer）；驗證過的 token 放進 TokenCache，
+// 同一個 token 再來時直接取回 JwtContext，不再 decode / 算 HMAC
 class JwtMiddleware
 {
    public:
@@ -42,15 +313,28 @@ class JwtMiddleware
         JwtContext jwt;
     };
 
+    using TokenCacheT = TokenCache<JwtContext>;
+
     JwtMiddleware()
         : secret_(Config::getEnvOrThrow("AUTH_JWT_SECRET")),
-          issuer_(Config::getEnvOrDefault("AUTH_JWT_ISSUER", "taskplanet")) {
+          issuer_(Config::getEnvOrDefault("AUTH_JWT_ISSUER", "taskplanet")),
+          verifier_(jwt::verify()
+                        .allow_algorithm(jwt::algorithm::hs256{secret_})
+                        .with_issuer(issuer_)) {
+        if (Config::jwtCacheEntries() > 0) {
+            TokenCacheOptions opt;
+            opt.maxEntries = static_cast<std::size_t>(Config::jwtCacheEntries());
+            opt.maxTtl     = std::chrono::seconds(Config::jwtCacheMaxTtlSec());
+            cache_         = std::make_unique<TokenCacheT>(opt);
+        }
         // 白名單（不需帶 token）
         whitelist_ = {
             "/ping", "/api/suggest", "/api/tags", "/api/suggestions/buffer"};
 #ifdef TP_ENABLE_DEV_LOGIN
         whitelist_.insert("/api/auth/dev-login");
 #endif
+        if (Config::metricsPublic())
+            whitelist_.insert("/metrics");
     }
 
     void before_handle(crow::request& req, crow::response& res, context& ctx) {
@@ -61,19 +345,18 @@ class JwtMiddleware
         if (isWhitelisted(req.url))
             return;
 
-        auto auth = req.get_header_value("Authorization");
-        if (auth.size() < 8 || auth.rfind("Bearer ", 0) != 0) {
+        // 命中快取時整條路徑不配置記憶體：header 取參考、token 用 string_view
+        const std::string_view token = bearer_token(req);
+        if (token.empty()) {
             unauthorized(res, "missing_or_invalid_authorization_header");
             return;
         }
 
-        const std::string token = auth.substr(7);
+        if (cache_ && cache_->find(token, ctx.jwt))
+            return;
         try {
-            auto decoded  = jwt::decode(token);
-            auto verifier = jwt::verify()
-                                .allow_algorithm(jwt::algorithm::hs256{secret_})
-                                .with_issuer(issuer_);
-            verifier.verify(decoded);
+            auto decoded = jwt::decode(std::string(token));
+            verifier_.verify(decoded);
 
             auto get_claim_str = [&](const char* k) -> std::string {
                 if (!decoded.has_payload_claim(k))
@@ -82,36 +365,35 @@ class JwtMiddleware
             };
 
             ctx.jwt.authenticated = true;
-            ctx.jwt.sub           = get_claim_str("sub");
-            ctx.jwt.role          = get_claim_str("role");
-            if (ctx.jwt.role.empty())
-                ctx.jwt.role = "user";
+            ctx.jwt.subject =
+                std::make_shared<const std::string>(get_claim_str("sub"));
+            ctx.jwt.role = parse_role(get_claim_str("role"));
+            if (cache_) {
+                const auto exp = decoded.has_expires_at()
+                                     ? decoded.get_expires_at()
+                                     : TokenCacheT::clock::time_point::max();
+                cache_->put(token, ctx.jwt, exp);
+            }
         }
         catch (const std::exception& e) {
-            unauthorized(res, std::string("invalid_token: ") + e.what());
+            unauthorized(res, "invalid_token: ", e.what());
         }
     }
 
     void after_handle(crow::request&, crow::response&, context&) {}
 
+    // 驗證快取（JWT_CACHE_ENTRIES=0 時為 nullptr）
+    const TokenCacheT* token_cache() const { return cache_.get(); }
+
     // handler 端可用的小幫手
-    static bool requiresRoleOr403(const JwtContext&  jwt,
-                                  const std::string& need,
-                                  crow::response&    res) {
+    static bool requiresRoleOr403(const JwtContext& jwt,
+                                  Role              need,
+                                  crow::response&   res) {
         if (!jwt.authenticated) {
             unauthorized(res, "unauthenticated");
             return false;
         }
-        auto rank = [](const std::string& r) -> int {
-            if (r == "guest")
-                return 0;
-            if (r == "user")
-                return 1;
-            if (r == "admin")
-                return 2;
-            return -1;
-        };
-        if (rank(jwt.role) < rank(need)) {
+        if (static_cast<int>(jwt.role) < static_cast<int>(need)) {
             res.code = 403;
             res.set_header("Content-Type", "application/json");
             res.write(R"({"error":"forbidden"})");
@@ -122,10 +404,14 @@ class JwtMiddleware
     }
 
    private:
-    static void unauthorized(crow::response& res, const std::string& msg) {
+    // 錯誤訊息直接寫進 body（不先組一個暫存字串）
+    static void unauthorized(crow::response&  res,
+                             std::string_view msg,
+                             std::string_view detail = {}) {
         res.code = 401;
         res.set_header("Content-Type", "application/json");
-        res.write(std::string(R"({"error":")") + msg + R"("})");
+        res.body.reserve(16 + msg.size() + detail.size());
+        res.body.append(R"({"error":")").append(msg).append(detail).append(R"("})");
         res.end();
     }
 
@@ -133,7 +419,11 @@ class JwtMiddleware
         return whitelist_.count(path) > 0;
     }
 
+    using Verifier = std::decay_t<decltype(jwt::verify())>;
+
     std::string                     secret_;
     std::string                     issuer_;
+    Verifier                        verifier_; // verify() 是 const，可多執行緒共用
+    std::unique_ptr<TokenCacheT>    cache_;
     std::unordered_set<std::string> whitelist_;
 };
@@ -3,12 +3,21 @@
 #include "crow_all.h"
 #include "middleware.hpp"
 #include "../db/pool.hpp"
+#include "../index/recommend_index.hpp"
+#include "../index/trigram_index.hpp"
+#include "../cache/tag_dictionary.hpp"
+#include "../cache/recommend_cache.hpp"
+#include "../services/event_ingestor.hpp"
+#include "../domain/ranking_profile.hpp"
+#include "../config/config.hpp"
 
 // 各 controller 的 attach_* 宣告
 #include "../controllers/suggest_controller.hpp"
 #include "../controllers/suggestions_controller.hpp"
 #include "../controllers/events_controller.hpp"
 #include "../controllers/tags_controller.hpp"
+#include "../controllers/admin_controller.hpp"
+#include "../controllers/metrics_controller.hpp"
 
 // 安全防呆：禁止在 Release 搭配 dev-login
 #if defined(TP_ENABLE_DEV_LOGIN) && defined(NDEBUG)
@@ -36,16 +45,103 @@ inline std::string tp_issue_dev_token(const std::string& sub,
 
 namespace app {
 
-    inline void register_routes(App& app, DbPool& pool) {
+    inline void register_routes(App&                 app,
+                                DbPool&              pool,
+                                RecommendIndex*      recommendIndex = nullptr,
+                                EventIngestor*       eventIngestor  = nullptr,
+                                TrigramIndex*        trigramIndex   = nullptr,
+                                double               simThreshold   = 0.87,
+                                const TagDictionary* tagDictionary  = nullptr,
+                                RecommendCache*      recommendCache = nullptr,
+                                WeightDeltaSink*     weightSink     = nullptr,
+                                RankingProfileStore* ranking        = nullptr) {
+        // 權重寫入後的增量接收者：未指定時沿用常駐推薦索引
+        WeightDeltaSink* sink = weightSink ? weightSink : recommendIndex;
+
         // 健康檢查
-        CROW_ROUTE(app, "/")([] { return crow::response{200, "ok"}; });
-        CROW_ROUTE(app, "/ping").methods(crow::HTTPMethod::GET)([] {
+        TP_ROUTE(app, "/")([] { return crow::response{200, "ok"}; });
+        TP_ROUTE(app, "/ping").methods(crow::HTTPMethod::GET)([] {
             return crow::response{200, "pong"};
         });
 
+        // 連線池狀態與借出等待時間分布（buckets 為累積次數，le 單位：秒）
+        TP_ROUTE(app, "/health/db").methods(crow::HTTPMethod::GET)([&pool] {
+            const auto         st = pool.stats();
+            crow::json::wvalue out;
+            out["open"]            = st.open;
+            out["idle"]            = st.idle;
+            out["parked"]          = st.parked;
+            out["waiting"]         = st.waiting;
+            out["min"]             = st.minSize;
+            out["max"]             = st.maxSize;
+            out["acquires"]        = st.acquires;
+            out["affinityHits"]    = st.affinityHits;
+            out["timeouts"]        = st.timeouts;
+            out["opened"]          = st.opened;
+            out["evicted"]         = st.evicted;
+            out["connectFailures"] = st.connectFailures;
+
+            crow::json::wvalue::list buckets;
+            std::uint64_t            cumulative = 0;
+            for (std::size_t i = 0; i + 1 < LatencyHistogram::kBuckets; ++i) {
+                cumulative += st.wait.counts[i];
+                crow::json::wvalue b;
+                b["le"]    = LatencyHistogram::upper_bound_sec(i);
+                b["count"] = cumulative;
+                buckets.push_back(std::move(b));
+            }
+            out["waitSeconds"]["buckets"] = std::move(buckets);
+            out["waitSeconds"]["count"]   = st.wait.count;
+            out["waitSeconds"]["sum"] =
+                static_cast<double>(st.wait.sumMicros) / 1e6;
+            return crow::response{200, out};
+        });
+
+        // 推薦結果快取的命中率與記憶體用量（未啟用時 enabled=false）
+        TP_ROUTE(app, "/health/cache")
+            .methods(crow::HTTPMethod::GET)([recommendCache] {
+                crow::json::wvalue out;
+                out["enabled"] = recommendCache != nullptr;
+                if (!recommendCache)
+                    return crow::response{200, out};
+                const auto          st      = recommendCache->stats();
+                const std::uint64_t lookups = st.hits + st.misses;
+                out["hits"]       = st.hits;
+                out["misses"]     = st.misses;
+                out["stale"]      = st.stale;
+                out["coalesced"]  = st.coalesced;
+                out["evictions"]  = st.evictions;
+                out["generation"] = st.generation;
+                out["tagBumps"]   = st.tagBumps;
+                out["entries"]    = st.entries;
+                out["maxEntries"] = st.maxEntries;
+                out["bytes"]      = st.bytes;
+                out["hitRatio"] =
+                    lookups ? static_cast<double>(st.hits) / lookups : 0.0;
+                return crow::response{200, out};
+            });
+
+        // 事件聚合視窗：有 shard 的增量超過 EVENT_MAX_STALENESS_MS 還沒寫入就回 503
+        TP_ROUTE(app, "/health/events")
+            .methods(crow::HTTPMethod::GET)([eventIngestor] {
+                crow::json::wvalue out;
+                out["enabled"] = eventIngestor != nullptr;
+                if (!eventIngestor)
+                    return crow::response{200, out};
+                const auto st = eventIngestor->stats();
+
+                out["queueDepth"]      = st.queueDepth;
+                out["queueCapacity"]   = st.queueCapacity;
+                out["flushFailures"]   = st.flushFailures;
+                out["droppedRows"]     = st.droppedRows;
+                out["oldestPendingMs"] = st.oldestPending.count();
+                out["staleShards"]     = st.staleShards;
+                return crow::response{st.staleShards ? 503 : 200, out};
+            });
+
 #ifdef TP_ENABLE_DEV_LOGIN
         // 僅在開發啟用的發 token 端點
-        CROW_ROUTE(app, "/api/auth/dev-login")
+        TP_ROUTE(app, "/api/auth/dev-login")
             .methods(crow::HTTPMethod::POST)([](const crow::request&) {
                 crow::json::wvalue out;
                 out["token"] = tp_issue_dev_token("user-123", "user", 3600);
@@ -54,10 +150,23 @@ namespace app {
 #endif
 
         // 集中掛你原本分散在 controllers 裡的路由
-        attach_suggest_routes(app, pool);
-        attach_suggestions_routes(app, pool, 0.87);
-        attach_events_routes(app, pool); // 這裡面會保護 /api/events/adopt
-        attach_tags_routes(app, pool);
+        attach_suggest_routes(app,
+                              pool,
+                              recommendIndex,
+                              tagDictionary,
+                              recommendCache,
+                              ranking,
+                              Config::recommendExplore());
+        attach_suggestions_routes(
+            app, pool, simThreshold, sink, trigramIndex, tagDictionary);
+        attach_events_routes(app,
+                             pool,
+                             sink,
+                             eventIngestor,
+                             tagDictionary); // 這裡面會保護 /api/events/adopt
+        attach_tags_routes(app, pool, tagDictionary);
+        attach_admin_routes(app, ranking); // 需要 admin 角色
+        attach_metrics_routes(app, pool, recommendCache, eventIngestor);
     }
 
 } // namespace app
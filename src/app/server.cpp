@@ -3,6 +3,8 @@
 
 #include "../config/config.hpp"
 #include "../db/prepared.hpp"
+#include "../index/score_kernel.hpp"
+#include "../util/log.hpp"
 
 #include "../app/routes.hpp"
 
@@ -12,21 +14,241 @@ namespace app {
 
     Server::Server() {
         // 1) 環境變數
+        Log::set_level(parse_log_level(Config::logLevel(), LogLevel::Info));
         std::string connStr = Config::getDbConnStr();
         std::string schema  = Config::getDbSchema();
         if (schema.empty())
             schema = "public";
 
-        // 2) 初始化 DbPool
-        pool_ = std::make_shared<DbPool>(connStr, 8, [schema](pqxx::connection& c) {
+        // 2) 相似檢索方式：有 pg_trgm GIN 索引時改用 %（先開一條連線檢查）
+        const double   simThreshold = Config::simThreshold();
+        SimilarityPlan simPlan      = SimilarityPlan::Scan;
+        try {
+            pqxx::connection probe(connStr);
+            pqxx::work       w(probe);
+            w.exec("SET search_path TO " + schema + ", public");
+            w.commit();
+            simPlan = detect_similarity_plan(probe);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "[WARN] similarity plan probe failed: " << e.what() << "\n";
+        }
+        std::cout << "[INFO] suggest_similar uses "
+                  << (simPlan == SimilarityPlan::TrgmIndex ? "pg_trgm % + GIN index"
+                                                           : "sequential scan")
+                  << " (threshold=" << simThreshold << ")\n";
+
+        // 3) 初始化 DbPool
+        DbPool::Options popt;
+        using ms            = std::chrono::milliseconds;
+        popt.minSize        = static_cast<std::size_t>(Config::dbPoolMin());
+        popt.maxSize        = static_cast<std::size_t>(Config::dbPoolMax());
+        popt.idleTtl        = ms(Config::dbPoolIdleTtlMs());
+        popt.acquireTimeout = ms(Config::dbAcquireTimeoutMs());
+        popt.skipPingWithin = ms(Config::dbPingSkipMs());
+        popt.idlePingEvery  = ms(Config::dbIdlePingMs());
+        popt.affinity       = Config::dbPoolAffinity();
+        auto init = [schema, simPlan, simThreshold](pqxx::connection& c) {
             pqxx::work w(c);
             w.exec("SET search_path TO " + schema + ", public");
             w.commit();
-            register_prepared(c);
-        });
+            if (simPlan == SimilarityPlan::TrgmIndex)
+                set_similarity_threshold(c, simThreshold);
+            register_prepared(c, simPlan);
+        };
+        pool_ = std::make_shared<DbPool>(connStr, popt, init);
+        std::cout << "[INFO] db pool ready (min=" << popt.minSize
+                  << ", max=" << popt.maxSize
+                  << ", affinity=" << (popt.affinity ? "on" : "off") << ")\n";
+
+        // 4) tag 字典：tagCodes 轉 id 不再查 DB
+        start_tag_dictionary(connStr);
+
+        // 5) 排序權重 + 推薦結果快取 + 常駐推薦索引（皆可選）
+        //    快取要先建好：索引的背景對帳 thread 一啟動就可能用到它
+        load_ranking_profile();
+        if (Config::recommendCacheEntries() > 0)
+            start_recommend_cache();
+        if (Config::recommendMode() == "memory")
+            start_recommend_index();
+        weightSinks_.add(recommendCache_.get()); // 索引先套用增量，快取再失效
+
+        // 6) 常駐相似度索引（可選）：送出建議時的去重不再掃 tasks
+        if (Config::similarityMode() == "memory")
+            start_trigram_index();
+
+        // 7) 事件聚合視窗（可選）：async 全部事件、coalesce 只聚合 skip/impression
+        const std::string ingestMode = Config::eventIngestMode();
+        if (ingestMode == "async" || ingestMode == "coalesce")
+            start_event_ingestor(ingestMode == "async");
+
+        // 8) 限流規則（RateLimit middleware 建構時已依 Config 建好）
+        const auto& limits = app_.get_middleware<RateLimit>().rules();
+        std::cout << "[INFO] rate limit "
+                  << (limits.empty() ? "off" : "on") << " (rules=" << limits.size()
+                  << ", slots=" << Config::rateLimitSlots() << ")\n";
+
+        // 9) 健康檢查 掛上 API routes
+        register_routes(app_,
+                        *pool_,
+                        recommendIndex_.get(),
+                        eventIngestor_.get(),
+                        trigramIndex_.get(),
+                        simThreshold,
+                        &tagDictionary_,
+                        recommendCache_.get(),
+                        weight_sink(),
+                        &ranking_);
+    }
+
+    // 背景 thread 會用到其他成員：先全部停下，再照宣告的反序解構
+    Server::~Server() {
+        if (eventIngestor_)
+            eventIngestor_->stop();
+        indexRefresher_.stop();
+        taskIds_.stop();
+        trigramReloader_.stop();
+        tagDictionary_.stop();
+    }
+
+    void Server::load_ranking_profile() {
+        // 設定有誤時沿用預設權重，不擋啟動
+        RankingWeights w;
+        std::string    err;
+        if (!w.parse(Config::rankingWeights(), err)) {
+            std::cerr << "[WARN] RANKING_WEIGHTS ignored: " << err << "\n";
+            w = RankingWeights{};
+        }
+        const auto p = ranking_.swap(Config::rankingProfile(), w);
+        std::cout << "[INFO] ranking profile " << p->name
+                  << (p->weights.is_default() ? " (default weights)" : " (custom)")
+                  << "\n";
+    }
 
-        // 3) 健康檢查 掛上 API routes
-        register_routes(app_, *pool_);
+    void Server::start_tag_dictionary(const std::string& connStr) {
+        // 啟動時載入失敗就先走 DB，背景刷新成功後自動改用字典
+        try {
+            pool_->run([this](pqxx::connection& c) { tagDictionary_.reload(c); });
+            std::cout << "[INFO] tag dictionary loaded (tags="
+                      << tagDictionary_.snapshot()->codes.size() << ")\n";
+        }
+        catch (const std::exception& e) {
+            std::cerr << "[WARN] tag dictionary load failed: " << e.what() << "\n";
+        }
+        tagDictionary_.start(*pool_,
+                             connStr,
+                             std::chrono::seconds(Config::tagDictRefreshSec()),
+                             Config::tagDictNotifyChannel());
+    }
+
+    void Server::start_event_ingestor(bool includeAdopt) {
+        EventIngestor::Options opt;
+        opt.shards        = static_cast<std::size_t>(Config::eventAggShards());
+        opt.queueCapacity = static_cast<std::size_t>(Config::eventQueueCapacity());
+        opt.flushInterval =
+            std::chrono::milliseconds(Config::eventFlushIntervalMs());
+        opt.maxStaleness = std::chrono::milliseconds(Config::eventMaxStalenessMs());
+        opt.maxBatch     = static_cast<std::size_t>(Config::eventFlushBatch());
+        opt.includeAdopt = includeAdopt;
+        // 只收字典與常駐索引（db 模式：task id 集合）認得的 id；其餘同步寫入，
+        // 壞 id 由該請求失敗，不會以 200 進視窗再被 flush 丟掉
+        if (!recommendIndex_)
+            start_task_ids();
+        opt.known = [this](int taskId, const std::vector<int>& tagIds) {
+            const auto* snap = tagDictionary_.snapshot();
+            if (!snap)
+                return false;
+            for (int tagId : tagIds)
+                if (!snap->has_id(tagId))
+                    return false;
+            return recommendIndex_ ? recommendIndex_->has_task(taskId)
+                                   : taskIds_.contains(taskId);
+        };
+        eventIngestor_ = std::make_unique<EventIngestor>(*pool_, weight_sink(), opt);
+        eventIngestor_->start();
+        std::cout << "[INFO] event ingestor started (shards=" << opt.shards
+                  << ", queue=" << opt.queueCapacity
+                  << ", flush=" << opt.flushInterval.count() << "ms"
+                  << ", adopt=" << (includeAdopt ? "queued" : "sync") << ")\n";
+    }
+
+    void Server::start_task_ids() {
+        // 載入失敗時集合為空：全部事件走同步路徑，背景重載成功後才開始排入視窗
+        try {
+            pool_->run([this](pqxx::connection& c) { taskIds_.reload(c); });
+            std::cout << "[INFO] task id set loaded (tasks=" << taskIds_.size()
+                      << ")\n";
+        }
+        catch (const std::exception& e) {
+            std::cerr << "[WARN] task id set load failed: " << e.what() << "\n";
+        }
+        taskIds_.start(*pool_,
+                       std::chrono::seconds(Config::eventTaskIdsRefreshSec()));
+    }
+
+    void Server::start_recommend_cache() {
+        using std::size_t;
+        RecommendCache::Options opt;
+        opt.maxEntries    = static_cast<size_t>(Config::recommendCacheEntries());
+        opt.shards        = static_cast<size_t>(Config::recommendCacheShards());
+        opt.ttl           = std::chrono::milliseconds(Config::recommendCacheTtlMs());
+        opt.timeBucketMin = Config::recommendCacheTimeBucketMin();
+        recommendCache_   = std::make_unique<RecommendCache>(opt);
+        std::cout << "[INFO] recommend cache enabled (entries=" << opt.maxEntries
+                  << ", ttl=" << opt.ttl.count() << "ms"
+                  << ", timeBucket=" << opt.timeBucketMin << "min)\n";
+    }
+
+    void Server::start_recommend_index() {
+        recommendIndex_ = std::make_unique<RecommendIndex>(
+            std::chrono::seconds(Config::recommendIndexFullReloadSec()));
+        weightSinks_.add(recommendIndex_.get());
+        pool_->run([this](pqxx::connection& c) { recommendIndex_->reload(c); });
+        std::cout << "[INFO] recommend index loaded (tasks="
+                  << recommendIndex_->task_count()
+                  << ", kernel=" << scoring::kernel().name << ")\n";
+
+        // 寫入路徑會同步套用增量；這裡只補對帳（updated_at > watermark），
+        // 失敗時保留舊資料繼續服務
+        indexRefresher_.start(
+            std::chrono::seconds(Config::recommendIndexRefreshSec()), [this] {
+                try {
+                    const auto changes = pool_->run([this](pqxx::connection& c) {
+                        return recommendIndex_->refresh(c);
+                    });
+                    // 對帳真的改到的部分才讓推薦結果失效
+                    if (recommendCache_ && changes.all)
+                        recommendCache_->invalidate();
+                    else if (recommendCache_)
+                        recommendCache_->invalidate_tags(changes.tags);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "[WARN] recommend index refresh failed: "
+                              << e.what() << "\n";
+                }
+            });
+    }
+
+    void Server::start_trigram_index() {
+        trigramIndex_ = std::make_unique<TrigramIndex>();
+        pool_->run([this](pqxx::connection& c) { trigramIndex_->reload(c); });
+        std::cout << "[INFO] trigram index loaded (tasks="
+                  << trigramIndex_->task_count()
+                  << ", grams=" << trigramIndex_->gram_count() << ")\n";
+
+        // 本服務不新增任務（任務由其他途徑寫入），新增、修改與刪除都靠定期全量重建
+        trigramReloader_.start(
+            std::chrono::seconds(Config::similarityIndexReloadSec()), [this] {
+                try {
+                    pool_->run([this](pqxx::connection& c) {
+                        trigramIndex_->reload(c);
+                    });
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "[WARN] trigram index reload failed: " << e.what()
+                              << "\n";
+                }
+            });
     }
 
     int Server::run(uint16_t port) {
@@ -36,6 +258,17 @@ namespace app {
         std::cout << "[INFO] Server listening on :" << port << " (schema=" << schema
                   << ")\n";
         app_.port(port).multithreaded().run();
+
+        // 停止接收請求後，把佇列中的事件寫完再離開
+        if (eventIngestor_) {
+            eventIngestor_->stop();
+            auto st = eventIngestor_->stats();
+            std::cout << "[INFO] event ingestor drained (accepted=" << st.accepted
+                      << ", rejected=" << st.rejected
+                      << ", increments=" << st.increments
+                      << ", rows=" << st.flushedRows << ")\n";
+        }
+        Log::flush();
         return 0;
     }
 
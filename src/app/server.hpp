@@ -2,22 +2,53 @@
 #include "crow_all.h"
 #include "middleware.hpp"
 #include "../db/pool.hpp"
+#include "../index/recommend_index.hpp"
+#include "../index/trigram_index.hpp"
+#include "../cache/tag_dictionary.hpp"
+#include "../cache/recommend_cache.hpp"
+#include "../cache/task_ids.hpp"
+#include "../domain/ranking_profile.hpp"
+#include "../services/event_ingestor.hpp"
+#include "../util/periodic.hpp"
 
 namespace app {
 
-    using App = crow::App<Cors, JwtMiddleware>;
+    // 順序即執行順序：計時包住全部、限流在驗證 JWT 之前
+    using App = crow::App<RequestMetrics, Cors, RateLimit, JwtMiddleware>;
 
     class Server
     {
        public:
         Server();
+        ~Server();
         int                     run(uint16_t port);
         App&                    app() { return app_; }
         std::shared_ptr<DbPool> pool() { return pool_; }
 
        private:
-        App                     app_;
-        std::shared_ptr<DbPool> pool_;
+        App                             app_;
+        std::shared_ptr<DbPool>         pool_;
+        TagDictionary                   tagDictionary_; // tag code → id
+        RankingProfileStore             ranking_;       // 目前的排序權重
+        std::unique_ptr<RecommendIndex> recommendIndex_; // RECOMMEND_MODE=memory
+        std::unique_ptr<RecommendCache> recommendCache_; // 0 筆時不建立
+        PeriodicWorker                  indexRefresher_; // 用到上面兩者，須在其後
+        WeightDeltaFanout               weightSinks_;    // 權重寫入後的增量接收者
+        TaskIdSet                       taskIds_; // 無常駐索引時驗證 task_id
+        std::unique_ptr<EventIngestor>  eventIngestor_; // 聚合視窗（可選）
+        std::unique_ptr<TrigramIndex>   trigramIndex_;  // SIMILARITY_MODE=memory
+        PeriodicWorker                  trigramReloader_;
+
+        void start_tag_dictionary(const std::string& connStr);
+        void load_ranking_profile();
+        void start_recommend_index();
+        void start_recommend_cache();
+        WeightDeltaSink* weight_sink() {
+            return weightSinks_.empty() ? nullptr : &weightSinks_;
+        }
+        void start_trigram_index();
+        void start_event_ingestor(bool includeAdopt);
+        void start_task_ids();
     };
 
 } // namespace app
@@ -0,0 +1,298 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../domain/tag_set.hpp"
+#include "../repositories/weight_repo.hpp"
+#include "../services/recommend_service.hpp"
+
+// 推薦結果快取的容量與失效策略
+struct RecommendCacheOptions
+{
+    std::size_t               shards     = 16;
+    std::size_t               maxEntries = 4096; // 所有 shard 合計
+    std::chrono::milliseconds ttl{5000}; // 0 = 只靠 generation 失效
+    int timeBucketMin = 5; // timeMinutes 量化成此倍數（1 = 不量化）
+};
+
+/// Sharded LRU cache in front of RecommendService::recommend
+/// - key = TagSet (already de-duplicated) + quantized timeMinutes + limit +
+///   ranking profile version (a profile swap never serves old scores); the
+///   result is computed for the quantized time, so a hit returns exactly what a
+///   miss would have computed
+/// - a result for tag set T only reads the postings of the tags in T, so every
+///   tag has its own generation and an entry stores the sum over its key's tags;
+///   apply() (the WeightDeltaSink hook on the event write path) and
+///   invalidate_tags() bump only the touched tags, so a write to one tag leaves
+///   entries for unrelated tag sets cached
+/// - invalidate() bumps a global generation for changes that can touch any
+///   result (task rows, full index reload); older entries turn into misses
+///   without being touched
+/// - ttl bounds staleness from writes that bypass this process
+/// - concurrent misses on the same key wait for a single computation
+/// - hits hand out a shared immutable result, so serving one copies nothing
+class RecommendCache : public WeightDeltaSink
+{
+   public:
+    using Options = RecommendCacheOptions;
+    using Items   = std::vector<RecommendItem>;
+    using Result  = std::shared_ptr<const Items>;
+
+    struct Key
+    {
+        TagSet        tags;
+        int           time    = 0;
+        int           limit   = 0;
+        std::uint64_t profile = 0; // RankingProfile::version
+
+        bool operator==(const Key& o) const {
+            return time == o.time && limit == o.limit && profile == o.profile &&
+                   tags == o.tags;
+        }
+    };
+
+    struct Stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;    // 含 stale
+        std::uint64_t stale;     // 找到但 generation/ttl 已過期
+        std::uint64_t coalesced; // 等待別人正在算的同一個 key
+        std::uint64_t evictions;
+        std::uint64_t generation;
+        std::uint64_t tagBumps; // 單一 tag 失效的次數
+        std::size_t   entries;
+        std::size_t   maxEntries;
+        std::size_t   bytes; // 結果本身的估計記憶體用量
+    };
+
+    explicit RecommendCache(Options opt = {}) : opt_(opt) {
+        opt_.shards        = std::max<std::size_t>(1, opt_.shards);
+        opt_.timeBucketMin = std::max(1, opt_.timeBucketMin);
+        perShard_ = std::max<std::size_t>(1, opt_.maxEntries / opt_.shards);
+        for (std::size_t i = 0; i < opt_.shards; ++i)
+            shards_.push_back(std::make_unique<Shard>());
+    }
+
+    RecommendCache(const RecommendCache&)            = delete;
+    RecommendCache& operator=(const RecommendCache&) = delete;
+
+    /// Normalized key; callers compute with key.tags / key.time on a miss
+    Key make_key(TagSet        tags,
+                 int           timeMinutes,
+                 int           limit,
+                 std::uint64_t profile = 0) const {
+        Key k;
+        k.tags    = std::move(tags);
+        k.limit   = limit;
+        k.profile = profile;
+        // <= 0 代表使用者沒給時間（time_fit 固定 0.8），不量化
+        const int b = opt_.timeBucketMin;
+        k.time = timeMinutes <= 0 ? 0 : std::max(b, (timeMinutes + b / 2) / b * b);
+        return k;
+    }
+
+    /// Cached result for key, or compute() (outside any lock) and cache it
+    template <typename Fn>
+    Result get_or_compute(const Key& key, Fn&& compute) {
+        Shard&              sh    = shard_for(key);
+        const std::uint64_t gen   = generation_.load(std::memory_order_acquire);
+        const std::uint64_t stamp = tag_stamp(key.tags);
+        const auto          now   = clock::now();
+
+        std::unique_lock<std::mutex> lk(sh.mu);
+        if (auto it = sh.map.find(key); it != sh.map.end()) {
+            Entry&     e     = *it->second;
+            const bool fresh = e.gen == gen && e.stamp == stamp;
+            if (fresh && (opt_.ttl.count() == 0 || now < e.expires)) {
+                sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return e.value;
+            }
+            stale_.fetch_add(1, std::memory_order_relaxed);
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        if (auto in = sh.inflight.find(key); in != sh.inflight.end()) {
+            std::shared_future<Result> waitFor = in->second;
+            lk.unlock();
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+            return waitFor.get(); // 算的那一方失敗時同樣丟出例外
+        }
+        std::promise<Result> promise;
+        sh.inflight.emplace(key, promise.get_future().share());
+        lk.unlock();
+
+        Result value;
+        try {
+            value = std::make_shared<const Items>(compute());
+        }
+        catch (...) {
+            promise.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> g(sh.mu);
+            sh.inflight.erase(key);
+            throw;
+        }
+        promise.set_value(value);
+
+        std::lock_guard<std::mutex> g(sh.mu);
+        sh.inflight.erase(key);
+        // 計算期間 generation 變了：結果可能已過期，只回給這次請求，不放進快取
+        if (generation_.load(std::memory_order_acquire) == gen &&
+            tag_stamp(key.tags) == stamp)
+            insert(sh, key, value, gen, stamp, now + opt_.ttl);
+        return value;
+    }
+
+    /// Drop everything cached so far (lazily, via the generation counter)
+    void invalidate() { generation_.fetch_add(1, std::memory_order_acq_rel); }
+
+    /// Drop every entry whose tag set contains one of these tags
+    void invalidate_tags(const std::vector<int>& tagIds) {
+        for (int id : tagIds) bump_tag(id);
+    }
+
+    /// WeightDeltaSink: a committed alpha/beta change only touches its own tag
+    void apply(const std::vector<WeightDelta>& ds) override {
+        for (auto const& d : ds) bump_tag(d.tag_id);
+    }
+
+    Stats stats() const {
+        Stats st{};
+        st.hits       = hits_.load(std::memory_order_relaxed);
+        st.misses     = misses_.load(std::memory_order_relaxed);
+        st.stale      = stale_.load(std::memory_order_relaxed);
+        st.coalesced  = coalesced_.load(std::memory_order_relaxed);
+        st.evictions  = evictions_.load(std::memory_order_relaxed);
+        st.generation = generation_.load(std::memory_order_relaxed);
+        st.tagBumps   = tagBumps_.load(std::memory_order_relaxed);
+        st.maxEntries = perShard_ * shards_.size();
+        for (auto const& sh : shards_) {
+            std::lock_guard<std::mutex> lk(sh->mu);
+            st.entries += sh->map.size();
+            st.bytes += sh->bytes;
+        }
+        return st;
+    }
+
+   private:
+    using clock = std::chrono::steady_clock;
+
+    // inline 範圍的 tag id 各佔一格，其餘 id 取模共用（只會多失效，不會漏）
+    static constexpr std::size_t kTagSlots = TagSet::kInlineBits;
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& k) const {
+            std::uint64_t h   = 1469598103934665603ULL; // FNV-1a
+            auto          mix = [&h](std::uint64_t v) {
+                h ^= v;
+                h *= 1099511628211ULL;
+            };
+            mix(k.tags.hash());
+            mix(static_cast<std::uint32_t>(k.time) | (std::uint64_t(1) << 40));
+            mix(static_cast<std::uint32_t>(k.limit) | (std::uint64_t(1) << 41));
+            mix(k.profile);
+            return static_cast<std::size_t>(h ^ (h >> 32));
+        }
+    };
+
+    struct Entry
+    {
+        Key               key;
+        Result            value;
+        std::uint64_t     gen;
+        std::uint64_t     stamp; // 計算時 key 內各 tag 的 generation 總和
+        clock::time_point expires;
+        std::size_t       bytes;
+    };
+
+    struct Shard
+    {
+        using Pos = std::list<Entry>::iterator;
+
+        std::mutex                                                   mu;
+        std::list<Entry>                                             lru; // 新→舊
+        std::unordered_map<Key, Pos, KeyHash>                        map;
+        std::unordered_map<Key, std::shared_future<Result>, KeyHash> inflight;
+        std::size_t                                                  bytes = 0;
+    };
+
+    Options                             opt_;
+    std::size_t                         perShard_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::array<std::atomic<std::uint64_t>, kTagSlots> tagGen_{};
+
+    std::atomic<std::uint64_t> generation_{0};
+    std::atomic<std::uint64_t> tagBumps_{0};
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> stale_{0};
+    std::atomic<std::uint64_t> coalesced_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+
+    static std::size_t tag_slot(int tagId) {
+        return static_cast<std::uint32_t>(tagId) % kTagSlots;
+    }
+
+    // generation 只增不減，所以 key 內任一 tag 被 bump 後總和一定變大
+    std::uint64_t tag_stamp(const TagSet& tags) const {
+        std::uint64_t sum = 0;
+        tags.for_each([&](int id) {
+            sum += tagGen_[tag_slot(id)].load(std::memory_order_acquire);
+        });
+        return sum;
+    }
+
+    void bump_tag(int tagId) {
+        tagGen_[tag_slot(tagId)].fetch_add(1, std::memory_order_acq_rel);
+        tagBumps_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Shard& shard_for(const Key& key) {
+        return *shards_[KeyHash{}(key) % shards_.size()];
+    }
+
+    static std::size_t footprint(const Key& key, const Items& items) {
+        std::size_t n = sizeof(Entry) +
+                        key.tags.overflow().capacity() * sizeof(int) +
+                        items.capacity() * sizeof(RecommendItem);
+        for (auto const& it : items) n += it.description.capacity();
+        return n;
+    }
+
+    // 呼叫端持有 sh.mu
+    void insert(Shard&            sh,
+                const Key&        key,
+                Result            value,
+                std::uint64_t     gen,
+                std::uint64_t     stamp,
+                clock::time_point expires) {
+        const std::size_t bytes = footprint(key, *value);
+        if (auto it = sh.map.find(key); it != sh.map.end()) {
+            sh.bytes -= it->second->bytes;
+            sh.lru.erase(it->second);
+            sh.map.erase(it);
+        }
+        sh.lru.push_front(Entry{key, std::move(value), gen, stamp, expires, bytes});
+        sh.map.emplace(key, sh.lru.begin());
+        sh.bytes += bytes;
+        while (sh.map.size() > perShard_) {
+            auto& last = sh.lru.back();
+            sh.bytes -= last.bytes;
+            sh.map.erase(last.key);
+            sh.lru.pop_back();
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
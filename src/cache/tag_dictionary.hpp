@@ -0,0 +1,229 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../db/pool.hpp"
+#include "../repositories/tag_repo.hpp"
+#include "tags_response.hpp"
+#include "../util/log.hpp"
+#include "../util/periodic.hpp"
+
+/// Process-wide tag code → id dictionary (replaces TagRepo::ids_by_codes)
+/// - the whole tag_dim table lives in an immutable Snapshot: codes sorted in a
+///   flat array with ids alongside, looked up by binary search
+/// - readers load the current snapshot pointer (acquire) and never lock;
+///   reload() builds a new snapshot and publishes it with a single store (RCU)
+/// - replaced snapshots are retained rather than freed, so a reader can never
+///   see a dangling pointer; a snapshot is only published when the content
+///   actually changed, and tag_dim changes on admin edits only
+/// - start() refreshes on a timer and, when a channel is given, on
+///   LISTEN/NOTIFY from a dedicated connection (see README for the trigger)
+/// - each snapshot also carries the serialized GET /api/tags response, so it is
+///   rebuilt exactly when tag_dim changes
+class TagDictionary
+{
+   public:
+    struct Snapshot
+    {
+        std::vector<std::string> codes; // 排序後
+        std::vector<int>         ids;   // 與 codes 對齊
+        std::vector<int>         idSet; // 排序後的 id（has_id 用）
+        std::uint64_t            version = 0; // tag_dim 內容的 hash
+        TagsResponse             tags;        // GET /api/tags 的回應
+
+        // 找不到回傳 0（tag_dim.id 從 1 開始）
+        int find(std::string_view code) const {
+            auto it = std::lower_bound(codes.begin(), codes.end(), code);
+            if (it == codes.end() || *it != code)
+                return 0;
+            return ids[static_cast<std::size_t>(it - codes.begin())];
+        }
+
+        bool has_id(int id) const {
+            return std::binary_search(idSet.begin(), idSet.end(), id);
+        }
+    };
+
+    TagDictionary() = default;
+    ~TagDictionary() { stop(); }
+
+    TagDictionary(const TagDictionary&)            = delete;
+    TagDictionary& operator=(const TagDictionary&) = delete;
+
+    /// Rebuild from tag_dim; returns true when a new snapshot was published
+    bool reload(pqxx::connection& c) {
+        auto                rows    = TagRepo(c).list_all(); // ORDER BY id
+        const std::uint64_t version = content_hash(rows);
+
+        std::lock_guard<std::mutex> lk(publishMu_);
+        const Snapshot*             cur = current_.load(std::memory_order_relaxed);
+        if (cur && cur->version == version)
+            return false;
+
+        auto snap     = std::make_unique<Snapshot>();
+        snap->version = version;
+        snap->tags    = TagsResponse::build(rows, version);
+        std::sort(rows.begin(), rows.end(), [](auto const& a, auto const& b) {
+            return a.code < b.code;
+        });
+        snap->codes.reserve(rows.size());
+        snap->ids.reserve(rows.size());
+        for (auto const& t : rows) {
+            snap->codes.push_back(t.code);
+            snap->ids.push_back(t.id);
+        }
+        snap->idSet = snap->ids;
+        std::sort(snap->idSet.begin(), snap->idSet.end());
+        current_.store(snap.get(), std::memory_order_release);
+        retained_.push_back(std::move(snap));
+        return true;
+    }
+
+    bool ready() const { return snapshot() != nullptr; }
+
+    /// Current snapshot; valid for the lifetime of the dictionary
+    const Snapshot* snapshot() const {
+        return current_.load(std::memory_order_acquire);
+    }
+
+    /// Same result as TagRepo::ids_by_codes: ids of known codes, each once
+    std::vector<int> ids_by_codes(const std::vector<std::string>& codes) const {
+        std::vector<int> out;
+        const Snapshot*  snap = snapshot();
+        if (!snap)
+            return out;
+        out.reserve(codes.size());
+        for (auto const& code : codes) {
+            const int id = snap->find(code);
+            if (id && std::find(out.begin(), out.end(), id) == out.end())
+                out.push_back(id);
+        }
+        return out;
+    }
+
+    /// Background refresh: every `every`, and on NOTIFY `channel` when non-empty
+    void start(DbPool&              pool,
+               std::string          connStr,
+               std::chrono::seconds every,
+               std::string          channel) {
+        pool_ = &pool;
+        timer_.start(every, [this] { refresh("timer"); });
+        if (channel.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lk(stopMu_);
+            stopping_ = false;
+        }
+        listener_ = std::thread([this, connStr = std::move(connStr), channel] {
+            listen(connStr, channel);
+        });
+    }
+
+    void stop() {
+        timer_.stop();
+        {
+            std::lock_guard<std::mutex> lk(stopMu_);
+            stopping_ = true;
+        }
+        stopCv_.notify_all();
+        if (listener_.joinable())
+            listener_.join();
+    }
+
+   private:
+    std::atomic<const Snapshot*>                 current_{nullptr};
+    std::mutex                                   publishMu_;
+    std::vector<std::unique_ptr<const Snapshot>> retained_; // publishMu_ 保護
+
+    DbPool*                 pool_ = nullptr;
+    PeriodicWorker          timer_;
+    std::thread             listener_;
+    std::mutex              stopMu_;
+    std::condition_variable stopCv_;
+    bool                    stopping_ = false;
+
+    struct Receiver : pqxx::notification_receiver
+    {
+        Receiver(pqxx::connection& c, const std::string& channel, bool& fired)
+            : pqxx::notification_receiver(c, channel), fired_(fired) {}
+        void operator()(const std::string&, int) override { fired_ = true; }
+        bool& fired_;
+    };
+
+    void refresh(const char* why) {
+        try {
+            const bool changed =
+                pool_->run([this](pqxx::connection& c) { return reload(c); });
+            if (changed)
+                TP_LOG_INFO("tag dictionary reloaded",
+                            log_kv("why", why),
+                            log_kv("tags", snapshot()->codes.size()));
+        }
+        catch (const std::exception& e) {
+            TP_LOG_WARN("tag dictionary refresh failed", log_kv("error", e.what()));
+        }
+    }
+
+    bool stopping() {
+        std::lock_guard<std::mutex> lk(stopMu_);
+        return stopping_;
+    }
+
+    // LISTEN 用自己的連線（不佔用連線池）；斷線後等幾秒重連，重連後先補一次刷新
+    void listen(const std::string& connStr, const std::string& channel) {
+        while (!stopping()) {
+            try {
+                pqxx::connection c(connStr);
+                bool             fired = false;
+                Receiver         r(c, channel, fired);
+                refresh("listen");
+                while (!stopping()) {
+                    c.await_notification(1, 0); // 每秒醒來檢查 stop
+                    if (fired) {
+                        fired = false;
+                        refresh("notify");
+                    }
+                }
+                return;
+            }
+            catch (const std::exception& e) {
+                TP_LOG_WARN("tag dictionary listener failed",
+                            log_kv("error", e.what()));
+            }
+            std::unique_lock<std::mutex> lk(stopMu_);
+            stopCv_.wait_for(
+                lk, std::chrono::seconds(5), [this] { return stopping_; });
+        }
+    }
+
+    // FNV-1a：內容沒變就不發布新 snapshot
+    static std::uint64_t content_hash(const std::vector<TagRow>& rows) {
+        std::uint64_t h   = 1469598103934665603ULL;
+        auto          mix = [&h](std::string_view s) {
+            for (unsigned char ch : s) {
+                h ^= ch;
+                h *= 1099511628211ULL;
+            }
+            h ^= 0xff; // 欄位分隔
+            h *= 1099511628211ULL;
+        };
+        for (auto const& t : rows) {
+            mix(std::to_string(t.id));
+            mix(t.code);
+            mix(t.label);
+            mix(t.group_code);
+            mix(t.is_active ? "1" : "0");
+        }
+        return h;
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <crow_all.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../repositories/tag_repo.hpp"
+#include "../util/gzip.hpp"
+
+/// Pre-serialized GET /api/tags body for one version of tag_dim
+/// - built once per TagDictionary snapshot, so the route only copies bytes
+/// - json is the identity body, gzip the compressed variant (empty without zlib)
+/// - etag is derived from the tag_dim content hash: same content, same tag,
+///   also across restarts and instances
+struct TagsResponse
+{
+    std::string json;
+    std::string gzip;
+    std::string etag;
+
+    static TagsResponse build(std::vector<TagRow> rows, std::uint64_t version) {
+        // 與 TagRepo::list_active 相同：只列啟用的 tag，依 group_code, code 排序
+        rows.erase(std::remove_if(rows.begin(),
+                                  rows.end(),
+                                  [](const TagRow& t) { return !t.is_active; }),
+                   rows.end());
+        std::sort(rows.begin(), rows.end(), [](auto const& a, auto const& b) {
+            return a.group_code != b.group_code ? a.group_code < b.group_code
+                                                : a.code < b.code;
+        });
+
+        crow::json::wvalue::list arr;
+        arr.reserve(rows.size());
+        for (auto& t : rows) {
+            crow::json::wvalue o;
+            o["id"]    = t.id;
+            o["code"]  = t.code;
+            o["label"] = t.label;
+            o["group"] = t.group_code;
+            arr.push_back(std::move(o));
+        }
+        crow::json::wvalue res;
+        res["tags"] = std::move(arr);
+
+        TagsResponse out;
+        out.json = res.dump();
+        out.gzip = gzip_compress(out.json);
+        char buf[24];
+        std::snprintf(buf, sizeof(buf), "\"%016llx\"",
+                      static_cast<unsigned long long>(version));
+        out.etag = buf;
+        return out;
+    }
+
+    // If-None-Match 可能是 "*"、W/ 前綴或逗號分隔的多個值
+    bool matches(const std::string& ifNoneMatch) const {
+        if (ifNoneMatch.empty())
+            return false;
+        if (ifNoneMatch == "*")
+            return true;
+        return ifNoneMatch.find(etag) != std::string::npos;
+    }
+};
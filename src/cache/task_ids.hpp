@@ -0,0 +1,72 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "../db/pool.hpp"
+#include "../repositories/task_repo.hpp"
+#include "../util/log.hpp"
+#include "../util/periodic.hpp"
+
+/// Resident set of tasks.id, for validating ids before they are queued
+/// - the ids live in an immutable sorted vector; readers take the current
+///   snapshot (shared_ptr, atomic load) and binary-search it without locking
+/// - reload() builds a new vector and publishes it with one atomic store; the
+///   old one is freed when its last reader drops it
+/// - start() reloads on a timer. A task created since the last reload is
+///   simply not known yet (callers fall back to their checked path); a task
+///   deleted since then is still known until the next reload
+class TaskIdSet
+{
+   public:
+    using Ids = std::vector<int>;
+
+    TaskIdSet() = default;
+    ~TaskIdSet() { stop(); }
+
+    TaskIdSet(const TaskIdSet&)            = delete;
+    TaskIdSet& operator=(const TaskIdSet&) = delete;
+
+    void reload(pqxx::connection& c) {
+        std::shared_ptr<const Ids> ids =
+            std::make_shared<const Ids>(TaskRepo(c).all_ids()); // 已排序
+        std::atomic_store_explicit(&ids_, std::move(ids), std::memory_order_release);
+    }
+
+    bool ready() const { return snapshot() != nullptr; }
+
+    bool contains(int taskId) const {
+        const auto ids = snapshot();
+        return ids && std::binary_search(ids->begin(), ids->end(), taskId);
+    }
+
+    std::size_t size() const {
+        const auto ids = snapshot();
+        return ids ? ids->size() : 0;
+    }
+
+    void start(DbPool& pool, std::chrono::seconds every) {
+        timer_.start(every, [this, &pool] {
+            try {
+                pool.run([this](pqxx::connection& c) { reload(c); });
+            }
+            catch (const std::exception& e) {
+                // 沿用舊的集合
+                TP_LOG_WARN("task id set reload failed", log_kv("error", e.what()));
+            }
+        });
+    }
+
+    void stop() { timer_.stop(); }
+
+   private:
+    std::shared_ptr<const Ids> ids_;
+    PeriodicWorker             timer_;
+
+    std::shared_ptr<const Ids> snapshot() const {
+        return std::atomic_load_explicit(&ids_, std::memory_order_acquire);
+    }
+};
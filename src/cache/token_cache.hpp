@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 已驗證 token 快取的容量與存活上限
+struct TokenCacheOptions
+{
+    std::size_t          shards     = 16;
+    std::size_t          maxEntries = 10000; // 所有 shard 合計
+    std::chrono::seconds maxTtl{3600};       // token 沒有 exp 時也不會永久留著
+};
+
+/// Sharded LRU of verified bearer tokens → whatever was derived from them
+/// - keyed by the full token string: the hash only picks the shard and bucket,
+///   so a colliding forged token can never hit another token's entry
+/// - every entry expires at min(token exp, insert time + maxTtl) on the wall
+///   clock, the same clock jwt-cpp checks exp against; expired entries are
+///   dropped on lookup and pushed out by LRU eviction
+/// - each shard holds at most maxEntries / shards entries
+template <typename Value>
+class TokenCache
+{
+   public:
+    using Options = TokenCacheOptions;
+    using clock   = std::chrono::system_clock;
+
+    struct Stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses; // 含過期
+        std::uint64_t expired;
+        std::uint64_t evictions;
+        std::size_t   entries;
+        std::size_t   maxEntries;
+    };
+
+    explicit TokenCache(Options opt = {}) : opt_(opt) {
+        opt_.shards = std::max<std::size_t>(1, opt_.shards);
+        perShard_   = std::max<std::size_t>(1, opt_.maxEntries / opt_.shards);
+        for (std::size_t i = 0; i < opt_.shards; ++i)
+            shards_.push_back(std::make_unique<Shard>());
+    }
+
+    TokenCache(const TokenCache&)            = delete;
+    TokenCache& operator=(const TokenCache&) = delete;
+
+    /// Copy the cached value into out; false when absent or expired
+    bool find(std::string_view token, Value& out) {
+        const std::size_t h   = std::hash<std::string_view>{}(token);
+        Shard&            sh  = shard_for(h);
+        const auto        now = clock::now();
+
+        std::lock_guard<std::mutex> lk(sh.mu);
+        auto                        it = sh.map.find(token);
+        if (it == sh.map.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (now >= it->second->expires) {
+            sh.lru.erase(it->second);
+            sh.map.erase(it);
+            expired_.fetch_add(1, std::memory_order_relaxed);
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        out = it->second->value;
+        return true;
+    }
+
+    /// Remember a verified token until exp (clock::time_point::max() = no exp)
+    void put(std::string_view token, Value value, clock::time_point exp) {
+        const auto now     = clock::now();
+        const auto ttlEnd  = now + opt_.maxTtl;
+        const auto expires = std::min(exp, ttlEnd);
+        if (expires <= now)
+            return;
+
+        const std::size_t           h  = std::hash<std::string_view>{}(token);
+        Shard&                      sh = shard_for(h);
+        std::lock_guard<std::mutex> lk(sh.mu);
+        if (auto it = sh.map.find(token); it != sh.map.end()) {
+            it->second->value   = std::move(value);
+            it->second->expires = expires;
+            sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+            return;
+        }
+        sh.lru.push_front(Entry{std::string(token), std::move(value), expires});
+        // map 的 key 指向 list 節點裡的字串（節點不會搬動）
+        sh.map.emplace(std::string_view(sh.lru.front().token), sh.lru.begin());
+        while (sh.map.size() > perShard_) {
+            sh.map.erase(std::string_view(sh.lru.back().token));
+            sh.lru.pop_back();
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    Stats stats() const {
+        Stats st{};
+        st.hits       = hits_.load(std::memory_order_relaxed);
+        st.misses     = misses_.load(std::memory_order_relaxed);
+        st.expired    = expired_.load(std::memory_order_relaxed);
+        st.evictions  = evictions_.load(std::memory_order_relaxed);
+        st.maxEntries = perShard_ * shards_.size();
+        for (auto const& sh : shards_) {
+            std::lock_guard<std::mutex> lk(sh->mu);
+            st.entries += sh->map.size();
+        }
+        return st;
+    }
+
+   private:
+    struct Entry
+    {
+        std::string       token;
+        Value             value;
+        clock::time_point expires;
+    };
+
+    struct Shard
+    {
+        using Pos = typename std::list<Entry>::iterator;
+
+        std::mutex                                mu;
+        std::list<Entry>                          lru; // 新→舊
+        std::unordered_map<std::string_view, Pos> map;
+    };
+
+    Options                             opt_;
+    std::size_t                         perShard_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> expired_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+
+    Shard& shard_for(std::size_t h) {
+        // 低位元給 unordered_map 用，shard 取高位元
+        return *shards_[(h >> 16) % shards_.size()];
+    }
+};
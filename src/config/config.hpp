@@ -36,10 +36,134 @@ class Config
         return "SET search_path TO " + getDbSchema() + ", public";
     }
 
+    // 連線池：啟動時開 min 條，不足時按需開到 max；借不到時 acquire 逾時回 503
+    static int dbPoolMin() { return std::max(1, getInt("DB_POOL_MIN", 2)); }
+    static int dbPoolMax() {
+        return std::max(dbPoolMin(), getInt("DB_POOL_MAX", 16));
+    }
+    static int dbPoolIdleTtlMs() {
+        return std::max(0, getInt("DB_POOL_IDLE_TTL_MS", 300000));
+    }
+    static int dbAcquireTimeoutMs() {
+        return std::max(0, getInt("DB_ACQUIRE_TIMEOUT_MS", 5000));
+    }
+    // 每個 worker 執行緒保留自己的連線（借還不經共用堆疊）
+    static bool dbPoolAffinity() { return getBool("DB_POOL_AFFINITY", false); }
+
+    // 借出前 ping 的策略：最近 N ms 內用過的連線直接借出；閒置連線由背景 ping
+    static int dbPingSkipMs() {
+        return std::max(0, getInt("DB_PING_SKIP_MS", 5000));
+    }
+    static int dbIdlePingMs() {
+        return std::max(0, getInt("DB_IDLE_PING_MS", 30000));
+    }
+
     // ---- Server ----
     static unsigned short getPort() {
         return static_cast<unsigned short>(getInt("PORT", 8080));
     }
+    // /metrics 不需 JWT（讓 Prometheus 直接抓；只在內網開放時使用）
+    static bool metricsPublic() { return getBool("METRICS_PUBLIC", false); }
+    // debug | info | warn | error | off（編譯期下限見 TP_LOG_MIN_LEVEL）
+    static std::string logLevel() { return toLower(getOr("LOG_LEVEL", "info")); }
+
+    // ---- Recommend ----
+    // db：每次請求執行 recommend_query；memory：常駐索引，PostgreSQL 只負責刷新
+    static std::string recommendMode() {
+        return toLower(getOr("RECOMMEND_MODE", "db"));
+    }
+    // 增量對帳間隔（只拉 updated_at 較新的列）
+    static int recommendIndexRefreshSec() {
+        return std::max(1, getInt("RECOMMEND_INDEX_REFRESH_SEC", 30));
+    }
+    // 全量重建間隔（處理刪除的任務）
+    static int recommendIndexFullReloadSec() {
+        return std::max(1, getInt("RECOMMEND_INDEX_FULL_RELOAD_SEC", 3600));
+    }
+
+    // /api/suggest 預設是否做 Thompson sampling（body 的 "explore" 可覆寫）
+    // 只在 memory 模式生效
+    static bool recommendExplore() { return getBool("RECOMMEND_EXPLORE", false); }
+
+    // 啟動時的排序 profile（之後可由 PUT /admin/ranking 換掉）
+    // RANKING_WEIGHTS 例：tag=0.6,time=0.2,quality=0.1,popularity=0.1
+    // 另有 base/mean（tag_fit 的組成）；沒給的權重用預設值（與 recommend_query 同）
+    static std::string rankingProfile() {
+        return getOr("RANKING_PROFILE", "default");
+    }
+    static std::string rankingWeights() { return getOr("RANKING_WEIGHTS", ""); }
+
+    // ---- Tags ----
+    // tag 字典的定期刷新間隔；NOTIFY 頻道為空字串時不 LISTEN
+    static int tagDictRefreshSec() {
+        return std::max(1, getInt("TAG_DICT_REFRESH_SEC", 300));
+    }
+    static std::string tagDictNotifyChannel() {
+        const char* v = std::getenv("TAG_DICT_NOTIFY_CHANNEL");
+        return v ? std::string(v) : std::string("tag_dim_changed");
+    }
+
+    // 推薦結果快取：0 筆 = 關閉；ttl 0 = 只靠事件寫入時的 generation 失效
+    static int recommendCacheEntries() {
+        return std::max(0, getInt("RECOMMEND_CACHE_ENTRIES", 4096));
+    }
+    static int recommendCacheShards() {
+        return std::clamp(getInt("RECOMMEND_CACHE_SHARDS", 16), 1, 256);
+    }
+    static int recommendCacheTtlMs() {
+        return std::max(0, getInt("RECOMMEND_CACHE_TTL_MS", 5000));
+    }
+    static int recommendCacheTimeBucketMin() {
+        return std::max(1, getInt("RECOMMEND_CACHE_TIME_BUCKET_MIN", 5));
+    }
+
+    // ---- Similarity ----
+    // 送出建議時判定為重複的門檻（pg_trgm similarity，嚴格大於）
+    static double simThreshold() {
+        const char* v = std::getenv("SIM_THRESHOLD");
+        if (!v || !*v)
+            return 0.87;
+        try {
+            return std::clamp(std::stod(v), 0.0, 1.0);
+        }
+        catch (...) {
+            return 0.87;
+        }
+    }
+    // db：每次送出建議執行 suggest_similar；memory：常駐 trigram 索引
+    static std::string similarityMode() {
+        return toLower(getOr("SIMILARITY_MODE", "db"));
+    }
+    static int similarityIndexReloadSec() {
+        return std::max(1, getInt("SIMILARITY_INDEX_RELOAD_SEC", 600));
+    }
+
+    // ---- Events ----
+    // sync：請求內直接寫 DB；async：佇列 + 背景批次寫入（write-behind）
+    static std::string eventIngestMode() {
+        return toLower(getOr("EVENT_INGEST_MODE", "sync"));
+    }
+    static int eventQueueCapacity() {
+        return std::max(1024, getInt("EVENT_QUEUE_CAPACITY", 65536));
+    }
+    static int eventFlushIntervalMs() {
+        return std::max(10, getInt("EVENT_FLUSH_INTERVAL_MS", 200));
+    }
+    static int eventFlushBatch() {
+        return std::max(1, getInt("EVENT_FLUSH_BATCH", 2000));
+    }
+    static int eventAggShards() {
+        return std::clamp(getInt("EVENT_AGG_SHARDS", 2), 1, 64);
+    }
+    // 沒有常駐推薦索引時，驗證 task_id 用的 id 集合多久重新載入一次
+    static int eventTaskIdsRefreshSec() {
+        return std::max(1, getInt("EVENT_TASK_IDS_REFRESH_SEC", 60));
+    }
+    // 增量在記憶體裡最多等多久：退避不會把重試延後到這之後，超過就回報 stale
+    static int eventMaxStalenessMs() {
+        return std::max(eventFlushIntervalMs(),
+                        getInt("EVENT_MAX_STALENESS_MS", 2000));
+    }
 
     // ---- Auth (JWT) ----
     static std::string jwtSecret() {
@@ -48,6 +172,13 @@ class Config
     }
     static std::string jwtIssuer() { return getOr("AUTH_ISS", "taskplanet-api"); }
     static std::string jwtAudience() { return getOr("AUTH_AUD", "taskplanet-web"); }
+    // 已驗證 token 的快取：0 筆 = 關閉；項目最晚在 token exp 或 max ttl 時失效
+    static int jwtCacheEntries() {
+        return std::max(0, getInt("JWT_CACHE_ENTRIES", 10000));
+    }
+    static int jwtCacheMaxTtlSec() {
+        return std::max(1, getInt("JWT_CACHE_MAX_TTL_SEC", 3600));
+    }
 
     // ---- CORS（預留，可選）----
     // 例：ALLOW_ORIGINS=https://taskplanet.app,https://admin.taskplanet.app
@@ -56,7 +187,7 @@ class Config
         return splitCsv(raw);
     }
 
-    // ---- Rate limit（預留，可選）----
+    // ---- Rate limit（RateLimit middleware；<= 0 關閉該項）----
     static int votePerMinPerToken() { return getInt("VOTE_PER_MIN_PER_TOKEN", 30); }
     static int votePerMinPerIP() { return getInt("VOTE_PER_MIN_PER_IP", 120); }
     static int suggestPerDayPerToken() {
@@ -65,6 +196,19 @@ class Config
     static int guestIssuePerMinPerIP() {
         return getInt("GUEST_ISSUE_PER_MIN_PER_IP", 10);
     }
+    static bool rateLimitEnabled() { return getBool("RATE_LIMIT_ENABLED", true); }
+    // 每條規則的 slot 數（每個 8 bytes），同時也是記憶體上限
+    static int rateLimitSlots() {
+        return std::max(64, getInt("RATE_LIMIT_SLOTS", 65536));
+    }
+    // 在反向代理後面時以 X-Forwarded-For 當 client IP（從右邊數，見 RateLimit）
+    static bool rateLimitTrustProxy() {
+        return getBool("RATE_LIMIT_TRUST_PROXY", false);
+    }
+    // 自己的代理層數：1 = 取最右邊一段
+    static int rateLimitProxyHops() {
+        return std::clamp(getInt("RATE_LIMIT_PROXY_HOPS", 1), 1, 16);
+    }
 
     static std::string getEnvOrThrow(const char* key) {
         const char* v = std::getenv(key);
@@ -0,0 +1,70 @@
+#pragma once
+#include <crow_all.h>
+#include <string>
+#include "../app/middleware.hpp"
+#include "../domain/ranking_profile.hpp"
+#include "../util/log.hpp"
+
+inline crow::json::wvalue ranking_profile_json(const RankingProfile& p) {
+    crow::json::wvalue out;
+    out["name"]                  = p.name;
+    out["version"]               = p.version;
+    out["default"]               = p.weights.is_default();
+    out["weights"]["tag"]        = p.weights.tag;
+    out["weights"]["time"]       = p.weights.time;
+    out["weights"]["quality"]    = p.weights.quality;
+    out["weights"]["popularity"] = p.weights.popularity;
+    out["weights"]["base"]       = p.weights.base;
+    out["weights"]["mean"]       = p.weights.mean;
+    return out;
+}
+
+// 管理端點：需要 admin 角色
+template <typename App>
+inline void attach_admin_routes(App& app, RankingProfileStore* ranking = nullptr) {
+    if (!ranking)
+        return;
+
+    // GET /admin/ranking：目前生效的排序 profile
+    // PUT /admin/ranking
+    // Body: { "name":"exp-b", "weights":{ "tag":0.6, "time":0.2, ... } }
+    //   沒給的權重用預設值；只給 name 等於換回預設權重
+    TP_ROUTE(app, "/admin/ranking")
+        .methods("GET"_method, "PUT"_method)(
+            [&app, ranking](const crow::request& req) {
+                crow::response authRes;
+                auto&          ctx = app.template get_context<JwtMiddleware>(req);
+                if (!JwtMiddleware::requiresRoleOr403(ctx.jwt, Role::Admin, authRes))
+                    return authRes;
+
+                if (req.method == crow::HTTPMethod::Get)
+                    return crow::response{200,
+                                          ranking_profile_json(*ranking->current())};
+
+                auto j = crow::json::load(req.body);
+                if (!j || j.t() != crow::json::type::Object)
+                    return crow::response{400, "invalid json"};
+                const std::string name =
+                    j.has("name") ? std::string(j["name"].s()) : "";
+                if (name.empty())
+                    return crow::response{400, "missing name"};
+
+                RankingWeights w;
+                if (j.has("weights")) {
+                    if (j["weights"].t() != crow::json::type::Object)
+                        return crow::response{400, "weights must be an object"};
+                    for (auto const& kv : j["weights"]) {
+                        const std::string key(kv.key());
+                        if (kv.t() != crow::json::type::Number ||
+                            !w.set(key, kv.d()))
+                            return crow::response{400, "invalid weight: " + key};
+                    }
+                }
+
+                const auto p = ranking->swap(name, w);
+                TP_LOG_INFO("ranking profile swapped",
+                            log_kv("name", p->name),
+                            log_kv("version", p->version));
+                return crow::response{200, ranking_profile_json(*p)};
+            });
+}
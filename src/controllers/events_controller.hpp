@@ -6,73 +6,121 @@
 #include "../db/prepared.hpp"
 #include "../repositories/tag_repo.hpp"
 #include "../services/event_service.hpp"
+#include "../services/event_ingestor.hpp"
+#include "../cache/tag_dictionary.hpp"
+#include "../dto/response.hpp"
 #include "../app/middleware.hpp" // << 新增：拿 JwtMiddleware context
 
+// sink：權重寫入後同步套用增量（常駐推薦索引），可為 nullptr
+// ingestor：聚合視窗（EVENT_INGEST_MODE=async|coalesce）；它接受的事件請求內不寫 DB
+// tags：tagCodes → id 的常駐字典；未載入時查 tag_dim
 template <typename App>
-inline void attach_events_routes(App& app, DbPool& pool) {
+inline void attach_events_routes(App&                 app,
+                                 DbPool&              pool,
+                                 WeightDeltaSink*     sink     = nullptr,
+                                 EventIngestor*       ingestor = nullptr,
+                                 const TagDictionary* tags     = nullptr) {
     // POST /api/events
     // Body: { "taskId":123, "event":"adopt"|"skip"|"impression", "tags":[1,2],
     // "tagCodes":[...] }
-    CROW_ROUTE(app, "/api/events")
-        .methods("POST"_method)([&app, &pool](const crow::request& req) {
-            // --- JWT 保護：需要 user+
-            crow::response authRes;
-            auto&          ctx = app.template get_context<JwtMiddleware>(req);
+    TP_ROUTE(app, "/api/events")
+        .methods("POST"_method)(
+            [&app, &pool, sink, ingestor, tags](const crow::request& req) {
+                // --- JWT 保護：需要 user+
+                crow::response authRes;
+                auto&          ctx = app.template get_context<JwtMiddleware>(req);
 
-            if (!JwtMiddleware::requiresRoleOr403(ctx.jwt, "user", authRes)) {
-                return authRes; // 401/403 已在 helper 內處理
-            }
-            const std::string userId = ctx.jwt.sub; // 可用於審計或風控
+                if (!JwtMiddleware::requiresRoleOr403(
+                        ctx.jwt, Role::User, authRes)) {
+                    return authRes; // 401/403 已在 helper 內處理
+                }
+                const std::string& userId = ctx.jwt.sub(); // 可用於審計或風控
 
-            auto j = crow::json::load(req.body);
-            if (!j)
-                return crow::response{400, "invalid json"};
+                auto j = crow::json::load(req.body);
+                if (!j)
+                    return crow::response{400, "invalid json"};
 
-            int taskId     = j.has("taskId") ? static_cast<int>(j["taskId"].i()) : 0;
-            std::string ev = j.has("event") ? std::string(j["event"].s()) : "";
+                int taskId = j.has("taskId") ? static_cast<int>(j["taskId"].i()) : 0;
+                std::string ev = j.has("event") ? std::string(j["event"].s()) : "";
 
-            std::vector<int> tagIds;
-            if (j.has("tags") && j["tags"].t() == crow::json::type::List) {
-                for (auto& v : j["tags"]) tagIds.push_back(static_cast<int>(v.i()));
-            }
-            std::vector<std::string> tagCodes;
-            if (j.has("tagCodes") && j["tagCodes"].t() == crow::json::type::List) {
-                for (auto& v : j["tagCodes"])
-                    tagCodes.emplace_back(std::string(v.s()));
-            }
-            if (!taskId || ev.empty())
-                return crow::response{400, "missing taskId or event"};
+                std::vector<int> tagIds;
+                if (j.has("tags") && j["tags"].t() == crow::json::type::List) {
+                    for (auto& v : j["tags"])
+                        tagIds.push_back(static_cast<int>(v.i()));
+                }
+                std::vector<std::string> tagCodes;
+                if (j.has("tagCodes") &&
+                    j["tagCodes"].t() == crow::json::type::List) {
+                    for (auto& v : j["tagCodes"])
+                        tagCodes.emplace_back(std::string(v.s()));
+                }
+                if (!taskId || ev.empty())
+                    return crow::response{400, "missing taskId or event"};
 
-            try {
-                auto h = pool.acquire();
+                try {
+                    // 聚合視窗接受的事件不在請求內寫 DB
+                    const bool windowable = ingestor && ingestor->accepts(ev);
+                    const bool codesInDb =
+                        !tagCodes.empty() && !(tags && tags->ready());
+                    DbPool::Handle h;
+                    if (codesInDb || !windowable)
+                        h = pool.acquire();
 
-                if (!tagCodes.empty()) {
-                    TagRepo tr(*h);
-                    auto    ids = tr.ids_by_codes(tagCodes);
-                    tagIds.insert(tagIds.end(), ids.begin(), ids.end());
-                }
+                    // h.run：剛借出未 ping 的連線若已斷，重連後重試第一個查詢
+                    if (codesInDb) {
+                        auto ids = h.run([&](pqxx::connection& c) {
+                            return TagRepo(c).ids_by_codes(tagCodes);
+                        });
+                        tagIds.insert(tagIds.end(), ids.begin(), ids.end());
+                    }
+                    else if (!tagCodes.empty()) {
+                        auto ids = tags->ids_by_codes(tagCodes);
+                        tagIds.insert(tagIds.end(), ids.begin(), ids.end());
+                    }
 
-                EventService svc(*h);
+                    // 含未知 task/tag 的事件改走同步寫入（EventService 會退回）
+                    const bool windowed =
+                        windowable && ingestor->knows(taskId, tagIds);
+                    if (!windowed && !h)
+                        h = pool.acquire();
 
-                // TODO: 若你要把 userId 寫入事件審計，將 handle_event 簽名改成：
-                // svc.handle_event(taskId, ev, tagIds, userId);
-                // 目前先沿用既有版本：
-                svc.handle_event(taskId, ev, tagIds);
+                    if (windowed) {
+                        h.release(); // 視窗模式不佔用連線
+                        EventService(*ingestor).handle_event(taskId, ev, tagIds);
+                    }
+                    else {
+                        // TODO: 若你要把 userId 寫入事件審計，
+                        // 將 handle_event 簽名改成：
+                        // svc.handle_event(taskId, ev, tagIds, userId);
+                        // 目前先沿用既有版本：
+                        h.run([&](pqxx::connection& c) {
+                            EventService(c, sink, ingestor)
+                                .handle_event(taskId, ev, tagIds);
+                        });
+                    }
 
-                // 回應
-                crow::json::wvalue ok;
-                ok["ok"]     = true;
-                ok["userId"] = userId; // 方便前端/QA 確認是誰上報
-                ok["event"]  = ev;
-                ok["taskId"] = taskId;
-                return crow::response{200, ok};
-            }
-            catch (const std::exception& e) {
-                crow::json::wvalue err;
-                err["error"] = e.what();
-                err["hint"] =
-                    "If this persists, contact support with the request payload.";
-                return crow::response{500, err};
-            }
-        });
+                    // 回應
+                    crow::json::wvalue ok;
+                    ok["ok"]     = true;
+                    ok["userId"] = userId; // 方便前端/QA 確認是誰上報
+                    ok["event"]  = ev;
+                    ok["taskId"] = taskId;
+                    if (windowed)
+                        ok["queued"] = true; // 已受理，稍後批次寫入
+                    return crow::response{200, ok};
+                }
+                catch (const EventIngestor::QueueFull&) {
+                    return busy_response("event_queue_full");
+                }
+                catch (const DbPoolTimeout&) {
+                    return busy_response("db_pool_timeout");
+                }
+                catch (const std::exception& e) {
+                    crow::json::wvalue err;
+                    err["error"] = e.what();
+                    err["hint"]  = "If this persists, contact support with the "
+                                  "request payload.";
+                    return crow::response{500, err};
+                }
+            });
 }
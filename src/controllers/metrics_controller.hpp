@@ -0,0 +1,303 @@
+#pragma once
+#include <crow_all.h>
+#include <string>
+#include <vector>
+#include "../app/middleware.hpp"
+#include "../cache/recommend_cache.hpp"
+#include "../config/config.hpp"
+#include "../db/pool.hpp"
+#include "../db/statement_timings.hpp"
+#include "../services/event_ingestor.hpp"
+#include "../util/log.hpp"
+#include "../util/metrics.hpp"
+
+namespace metrics_detail {
+
+    inline void http(std::string& out, const RequestMetrics& routes) {
+        static constexpr const char* kClass[] = {
+            "other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+        static constexpr double kQuantiles[] = {0.5, 0.9, 0.99};
+
+        prom::family(out,
+                     "tp_http_requests_total",
+                     "counter",
+                     "Requests by route and status class.");
+        routes.for_each([&](const RequestMetrics::Route& r) {
+            const auto snap  = r.latency.snapshot();
+            const auto route = prom::label("route", r.path);
+            for (std::size_t i = 0; i < HdrHistogram::kClasses; ++i)
+                if (snap.classes[i])
+                    prom::sample(out,
+                                 "tp_http_requests_total",
+                                 route + "," + prom::label("code", kClass[i]),
+                                 snap.classes[i]);
+        });
+
+        prom::family(out,
+                     "tp_http_request_duration_seconds",
+                     "histogram",
+                     "Time spent in the middleware chain and handler.");
+        routes.for_each([&](const RequestMetrics::Route& r) {
+            prom::histogram(out,
+                            "tp_http_request_duration_seconds",
+                            prom::label("route", r.path),
+                            r.latency.snapshot());
+        });
+
+        // HDR sub-bucket 精度（<= 25%）的分位數，自啟動以來
+        prom::family(out,
+                     "tp_http_request_duration_quantile_seconds",
+                     "gauge",
+                     "Latency quantiles since start (bucket upper bound).");
+        routes.for_each([&](const RequestMetrics::Route& r) {
+            const auto snap = r.latency.snapshot();
+            if (!snap.count)
+                return;
+            for (double q : kQuantiles) {
+                char qs[8];
+                std::snprintf(qs, sizeof qs, "%g", q);
+                prom::sample(out,
+                             "tp_http_request_duration_quantile_seconds",
+                             prom::label("route", r.path) + "," +
+                                 prom::label("quantile", qs),
+                             snap.quantile_sec(q));
+            }
+        });
+    }
+
+    inline void db(std::string& out, const DbPool& pool) {
+        const auto st = pool.stats();
+        prom::family(
+            out, "tp_db_pool_connections", "gauge", "Pooled connections by state.");
+        prom::sample(out, "tp_db_pool_connections", R"(state="open")", st.open);
+        prom::sample(out, "tp_db_pool_connections", R"(state="idle")", st.idle);
+        prom::sample(out,
+                     "tp_db_pool_connections",
+                     R"(state="in_use")",
+                     st.open > st.idle ? st.open - st.idle : 0);
+        prom::sample(out, "tp_db_pool_connections", R"(state="parked")", st.parked);
+        prom::family(out, "tp_db_pool_max_connections", "gauge", "DB_POOL_MAX.");
+        prom::sample(out, "tp_db_pool_max_connections", "", st.maxSize);
+        prom::family(out,
+                     "tp_db_pool_waiting",
+                     "gauge",
+                     "Callers waiting for a connection.");
+        prom::sample(out, "tp_db_pool_waiting", "", st.waiting);
+
+        prom::family(out,
+                     "tp_db_pool_events_total",
+                     "counter",
+                     "Pool acquires, timeouts and connection churn.");
+        auto event = [&](const char* name, std::uint64_t v) {
+            prom::sample(
+                out, "tp_db_pool_events_total", prom::label("event", name), v);
+        };
+        event("acquire", st.acquires);
+        event("affinity_hit", st.affinityHits);
+        event("timeout", st.timeouts);
+        event("opened", st.opened);
+        event("evicted", st.evicted);
+        event("connect_failure", st.connectFailures);
+
+        prom::family(out,
+                     "tp_db_pool_wait_seconds",
+                     "histogram",
+                     "Time callers waited to borrow a connection.");
+        prom::histogram(out, "tp_db_pool_wait_seconds", "", st.wait);
+
+        prom::family(out,
+                     "tp_db_statement_duration_seconds",
+                     "histogram",
+                     "Prepared statement round trips (pipeline = whole batch).");
+        StatementTimings::instance().for_each(
+            [&](const std::string& name, const LatencyHistogram& h) {
+                prom::histogram(out,
+                                "tp_db_statement_duration_seconds",
+                                prom::label("statement", name),
+                                h.snapshot());
+            });
+    }
+
+    struct CacheStats
+    {
+        const char*   name;
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::size_t   entries;
+    };
+
+    // Prometheus 要求同一個 family 的樣本連在一起：先 family、再逐個 cache
+    inline void caches(std::string&                      out,
+                       const RecommendCache*             recommend,
+                       const JwtMiddleware::TokenCacheT* tokens) {
+        std::vector<CacheStats> all;
+        if (recommend) {
+            const auto st = recommend->stats();
+            all.push_back(
+                {"recommend", st.hits, st.misses, st.evictions, st.entries});
+        }
+        if (tokens) {
+            const auto st = tokens->stats();
+            all.push_back({"jwt", st.hits, st.misses, st.evictions, st.entries});
+        }
+        if (all.empty())
+            return;
+
+        auto each = [&](const char* metric, const char* extra, auto value) {
+            for (auto const& c : all)
+                prom::sample(out,
+                             metric,
+                             prom::label("cache", c.name) + extra,
+                             value(c));
+        };
+        prom::family(out, "tp_cache_lookups_total", "counter", "Cache lookups.");
+        each("tp_cache_lookups_total", R"(,result="hit")", [](auto& c) {
+            return c.hits;
+        });
+        each("tp_cache_lookups_total", R"(,result="miss")", [](auto& c) {
+            return c.misses;
+        });
+        prom::family(
+            out, "tp_cache_hit_ratio", "gauge", "Hits / lookups since start.");
+        each("tp_cache_hit_ratio", "", [](auto& c) {
+            const std::uint64_t n = c.hits + c.misses;
+            return n ? static_cast<double>(c.hits) / n : 0.0;
+        });
+        prom::family(out, "tp_cache_evictions_total", "counter", "LRU evictions.");
+        each("tp_cache_evictions_total", "", [](auto& c) { return c.evictions; });
+        prom::family(out, "tp_cache_entries", "gauge", "Entries held.");
+        each("tp_cache_entries", "", [](auto& c) { return c.entries; });
+    }
+
+    inline void rate_limits(std::string& out, const RateLimit& limits) {
+        if (limits.rules().empty())
+            return;
+        prom::family(out,
+                     "tp_rate_limit_decisions_total",
+                     "counter",
+                     "Rate limiter decisions by route and key.");
+        auto one = [&](const std::string& path,
+                       const char*        key,
+                       const RateLimiter* l) {
+            if (!l)
+                return;
+            const auto st = l->stats();
+            const auto lb =
+                prom::label("route", path) + "," + prom::label("key", key);
+            prom::sample(out,
+                         "tp_rate_limit_decisions_total",
+                         lb + R"(,result="allowed")",
+                         st.allowed);
+            prom::sample(out,
+                         "tp_rate_limit_decisions_total",
+                         lb + R"(,result="rejected")",
+                         st.rejected);
+        };
+        for (auto const& r : limits.rules()) {
+            one(r.path, "token", r.perToken.get());
+            one(r.path, "ip", r.perIp.get());
+        }
+    }
+
+    inline void ingestor(std::string& out, const EventIngestor& ing) {
+        const auto st = ing.stats();
+        auto       by = [&](const char* name, const char* result, std::uint64_t v) {
+            prom::sample(out, name, prom::label("result", result), v);
+        };
+        prom::family(out,
+                     "tp_event_ingestor_events_total",
+                     "counter",
+                     "Events accepted into or rejected by the aggregation window.");
+        by("tp_event_ingestor_events_total", "accepted", st.accepted);
+        by("tp_event_ingestor_events_total", "rejected", st.rejected);
+        prom::family(out,
+                     "tp_event_ingestor_flushes_total",
+                     "counter",
+                     "Flush batches by outcome.");
+        by("tp_event_ingestor_flushes_total", "ok", st.flushes);
+        by("tp_event_ingestor_flushes_total", "failed", st.flushFailures);
+        prom::family(out,
+                     "tp_event_ingestor_flushed_rows_total",
+                     "counter",
+                     "(task, tag) rows written by flushes.");
+        prom::sample(
+            out, "tp_event_ingestor_flushed_rows_total", "", st.flushedRows);
+        prom::family(out,
+                     "tp_event_ingestor_dropped_rows_total",
+                     "counter",
+                     "(task, tag) rows dropped for violating a constraint.");
+        prom::sample(
+            out, "tp_event_ingestor_dropped_rows_total", "", st.droppedRows);
+        prom::family(
+            out, "tp_event_ingestor_queue_depth", "gauge", "Queued events.");
+        prom::sample(out, "tp_event_ingestor_queue_depth", "", st.queueDepth);
+        prom::family(out,
+                     "tp_event_ingestor_oldest_pending_seconds",
+                     "gauge",
+                     "Age of the oldest increment not yet written.");
+        prom::sample(out,
+                     "tp_event_ingestor_oldest_pending_seconds",
+                     "",
+                     static_cast<double>(st.oldestPending.count()) / 1e3);
+        prom::family(out,
+                     "tp_event_ingestor_stale_shards",
+                     "gauge",
+                     "Shards holding increments older than EVENT_MAX_STALENESS_MS.");
+        prom::sample(out, "tp_event_ingestor_stale_shards", "", st.staleShards);
+    }
+
+    inline void log(std::string& out) {
+        const auto st = Log::stats();
+        prom::family(out,
+                     "tp_log_lines_total",
+                     "counter",
+                     "Async logger lines by outcome.");
+        prom::sample(out, "tp_log_lines_total", R"(result="written")", st.written);
+        prom::sample(out, "tp_log_lines_total", R"(result="dropped")", st.dropped);
+        prom::sample(
+            out, "tp_log_lines_total", R"(result="suppressed")", st.suppressed);
+    }
+
+} // namespace metrics_detail
+
+// GET /metrics：Prometheus text format；所有數字都是現成的計數器快照，不碰 DB
+// METRICS_PUBLIC=false 時只給 Admin
+template <typename App>
+inline void attach_metrics_routes(App&                  app,
+                                  const DbPool&         pool,
+                                  const RecommendCache* recommendCache = nullptr,
+                                  const EventIngestor*  eventIngestor  = nullptr) {
+    const bool open = Config::metricsPublic();
+    TP_ROUTE(app, "/metrics")
+        .methods(crow::HTTPMethod::GET)([&app,
+                                         &pool,
+                                         recommendCache,
+                                         eventIngestor,
+                                         open](const crow::request& req) {
+            crow::response authRes;
+            auto&          ctx = app.template get_context<JwtMiddleware>(req);
+            if (!open &&
+                !JwtMiddleware::requiresRoleOr403(ctx.jwt, Role::Admin, authRes))
+                return authRes;
+
+            std::string out;
+            out.reserve(64 * 1024);
+            metrics_detail::http(out,
+                                 app.template get_middleware<RequestMetrics>());
+            metrics_detail::db(out, pool);
+            metrics_detail::caches(
+                out,
+                recommendCache,
+                app.template get_middleware<JwtMiddleware>().token_cache());
+            metrics_detail::rate_limits(out,
+                                        app.template get_middleware<RateLimit>());
+            if (eventIngestor)
+                metrics_detail::ingestor(out, *eventIngestor);
+            metrics_detail::log(out);
+
+            crow::response res{200, std::move(out)};
+            res.set_header("Content-Type", "text/plain; version=0.0.4");
+            return res;
+        });
+}
@@ -1,24 +1,46 @@
 #pragma once
 #include <crow_all.h>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include "../db/pool.hpp"
 #include "../db/prepared.hpp"
+#include "../domain/ranking_profile.hpp"
+#include "../domain/tag_set.hpp"
 #include "../repositories/tag_repo.hpp"
 #include "../services/recommend_service.hpp"
+#include "../index/recommend_index.hpp"
+#include "../cache/tag_dictionary.hpp"
+#include "../cache/recommend_cache.hpp"
+#include "../dto/response.hpp"
+#include "../app/middleware.hpp"
 
+// index 非空且已載入時走常駐索引（RECOMMEND_MODE=memory），否則走 recommend_query
+// tags 已載入時 tagCodes 直接在記憶體裡轉 id，否則查 tag_dim
+// cache 非空時相同的 (tag 集合, 時間區間, limit) 直接回快取結果，不借連線
+// ranking 非空時用目前的排序 profile，回應帶上 profile 名稱（A/B 實驗歸因）
+// explore：body 沒給 "explore" 時是否做 Thompson sampling（只在 memory 模式生效，
+// 抽樣結果不進快取）；"seed" 非 0 時結果可重現
 template <typename App>
-inline void attach_suggest_routes(App& app, DbPool& pool) {
-    CROW_ROUTE(app, "/api/suggest")
-        .methods("POST"_method)([&pool](const crow::request& req) {
+inline void attach_suggest_routes(App&                       app,
+                                  DbPool&                    pool,
+                                  const RecommendIndex*      index   = nullptr,
+                                  const TagDictionary*       tags    = nullptr,
+                                  RecommendCache*            cache   = nullptr,
+                                  const RankingProfileStore* ranking = nullptr,
+                                  bool                       explore = false) {
+    TP_ROUTE(app, "/api/suggest")
+        .methods("POST"_method)([&pool, index, tags, cache, ranking, explore](
+                                    const crow::request& req) {
             auto j = crow::json::load(req.body);
             if (!j)
                 return crow::response{400, "invalid json"};
 
-            std::vector<int> tagIds;
-            // 支援兩種輸入：tags (int[]) 或 tagCodes (string[])
+            // 支援兩種輸入：tags (int[]) 或 tagCodes (string[])；兩者都給時取聯集
+            TagSet tagSet;
             if (j.has("tags") && j["tags"].t() == crow::json::type::List) {
-                for (auto& v : j["tags"]) tagIds.push_back((int)v.i());
+                for (auto& v : j["tags"]) tagSet.insert((int)v.i());
             }
             std::vector<std::string> tagCodes;
             if (j.has("tagCodes") && j["tagCodes"].t() == crow::json::type::List) {
@@ -26,22 +48,73 @@ inline void attach_suggest_routes(App& app, DbPool& pool) {
                     tagCodes.emplace_back(std::string(v.s()));
             }
             int timeMin = j.has("time") ? (int)j["time"].i() : 10;
-            int limit   = j.has("limit") ? (int)j["limit"].i() : 20;
+            // 排序在截斷之前完成，不需要大 limit 換品質；上限避免大量序列化
+            // 先在 int64 上夾到 [1, 100] 再轉 int（0、負數或超大值都不會溢位）
+            const int limit = static_cast<int>(std::clamp<std::int64_t>(
+                j.has("limit") ? j["limit"].i() : 20, 1, 100));
+
+            ExploreOptions exploreOpt;
+            exploreOpt.enabled = explore;
+            if (j.has("explore"))
+                exploreOpt.enabled = j["explore"].t() == crow::json::type::True;
+            if (j.has("seed") && j["seed"].t() == crow::json::type::Number)
+                exploreOpt.seed = static_cast<std::uint64_t>(j["seed"].i());
 
             try {
-                auto h = pool.acquire();
+                // 整個請求用同一份 profile（換 profile 不影響進行中的請求）
+                const auto snapshot =
+                    ranking ? ranking->current() : RankingProfileStore::Snapshot{};
+                const RankingProfile* profile = snapshot.get();
+                const bool inMemory = index && index->ready();
+                const bool sampling = inMemory && exploreOpt.enabled;
+                const bool codesInDb =
+                    !tagCodes.empty() && !(tags && tags->ready());
+                DbPool::Handle h;
+                if (codesInDb)
+                    h = pool.acquire();
 
-                if (!tagCodes.empty()) {
-                    TagRepo tr(*h);
-                    auto    ids = tr.ids_by_codes(tagCodes);
-                    tagIds.insert(tagIds.end(), ids.begin(), ids.end());
+                // h.run：剛借出未 ping 的連線若已斷，重連後重試第一個查詢
+                if (codesInDb) {
+                    tagSet.insert(h.run([&](pqxx::connection& c) {
+                        return TagRepo(c).ids_by_codes(tagCodes);
+                    }));
+                }
+                else if (!tagCodes.empty()) {
+                    tagSet.insert(tags->ids_by_codes(tagCodes));
                 }
 
-                RecommendService svc(*h);
-                auto             items = svc.recommend(tagIds, timeMin, limit);
+                // db 模式到真的要算時才借連線（快取命中不碰連線池）
+                auto compute = [&](const TagSet& ids,
+                                   int minutes) -> std::vector<RecommendItem> {
+                    if (inMemory)
+                        return RecommendService(*index, profile)
+                            .recommend(ids, minutes, limit, exploreOpt);
+                    if (!h)
+                        h = pool.acquire();
+                    return h.run([&](pqxx::connection& c) {
+                        return RecommendService(c, profile)
+                            .recommend(ids, minutes, limit);
+                    });
+                };
+
+                RecommendCache::Result            cached;
+                std::vector<RecommendItem>        fresh;
+                const std::vector<RecommendItem>* items = &fresh;
+                if (cache && !sampling) {
+                    auto key = cache->make_key(std::move(tagSet),
+                                               timeMin,
+                                               limit,
+                                               profile ? profile->version : 0);
+                    cached   = cache->get_or_compute(
+                        key, [&] { return compute(key.tags, key.time); });
+                    items = cached.get();
+                }
+                else {
+                    fresh = compute(tagSet, timeMin);
+                }
 
                 crow::json::wvalue::list arr;
-                for (auto& it : items) {
+                for (auto& it : *items) {
                     crow::json::wvalue o;
                     o["id"]            = it.id;
                     o["description"]   = it.description;
@@ -54,8 +127,15 @@ inline void attach_suggest_routes(App& app, DbPool& pool) {
 
                 crow::json::wvalue res;
                 res["tasks"] = std::move(arr);
+                if (profile)
+                    res["profile"] = profile->name;
+                if (sampling)
+                    res["explore"] = true;
                 return crow::response{200, res};
             }
+            catch (const DbPoolTimeout&) {
+                return busy_response("db_pool_timeout");
+            }
             catch (const std::exception& e) {
                 crow::json::wvalue err;
                 err["error"] = e.what();
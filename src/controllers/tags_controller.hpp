@@ -1,16 +1,48 @@
 #pragma once
 #include <crow_all.h>
+#include <string>
 #include "../db/pool.hpp"
 #include "../repositories/tag_repo.hpp"
+#include "../cache/tag_dictionary.hpp"
+#include "../dto/response.hpp"
+#include "../app/middleware.hpp"
 
+// tags 已載入時直接送出預先序列化的回應（不借連線）；否則每次查 tag_dim
 template <typename App>
-inline void attach_tags_routes(App& app, DbPool& pool) {
-    CROW_ROUTE(app, "/api/tags")
-        .methods("GET"_method)([&pool](const crow::request&) {
+inline void attach_tags_routes(App&                 app,
+                               DbPool&              pool,
+                               const TagDictionary* tags = nullptr) {
+    TP_ROUTE(app, "/api/tags")
+        .methods("GET"_method)([&pool, tags](const crow::request& req) {
+            if (const auto* snap = tags ? tags->snapshot() : nullptr) {
+                const TagsResponse& cached = snap->tags;
+                crow::response      res;
+                res.set_header("ETag", cached.etag);
+                res.set_header("Cache-Control", "no-cache"); // 每次帶 ETag 重新驗證
+                res.set_header("Vary", "Accept-Encoding");
+                if (cached.matches(req.get_header_value("If-None-Match"))) {
+                    res.code = 304;
+                    return res;
+                }
+                res.code = 200;
+                res.set_header("Content-Type", "application/json");
+                const bool gzip =
+                    !cached.gzip.empty() &&
+                    req.get_header_value("Accept-Encoding").find("gzip") !=
+                        std::string::npos;
+                if (gzip) {
+                    res.set_header("Content-Encoding", "gzip");
+                    res.body = cached.gzip;
+                }
+                else {
+                    res.body = cached.json;
+                }
+                return res;
+            }
+
             try {
-                auto    h = pool.acquire(); // 連線池連線
-                TagRepo tr(*h);
-                auto    rows = tr.list_active();
+                auto rows = pool.run(
+                    [](pqxx::connection& c) { return TagRepo(c).list_active(); });
 
                 crow::json::wvalue::list arr;
                 arr.reserve(rows.size());
@@ -26,6 +58,9 @@ inline void attach_tags_routes(App& app, DbPool& pool) {
                 res["tags"] = std::move(arr);
                 return crow::response{200, res};
             }
+            catch (const DbPoolTimeout&) {
+                return busy_response("db_pool_timeout");
+            }
             catch (const std::exception& e) {
                 crow::json::wvalue err;
                 err["error"] = e.what();
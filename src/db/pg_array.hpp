@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../domain/tag_set.hpp"
+
+// int[] → Postgres 陣列字串 {1,2,3}，搭配 $n::int[] 參數化使用
+inline std::string to_pg_int_array(const std::vector<int>& v) {
+    std::string s = "{";
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (i)
+            s += ',';
+        s += std::to_string(v[i]);
+    }
+    s += "}";
+    return s;
+}
+
+// TagSet → {1,2,3}（遞增、不重複），不經過中間的 vector
+inline std::string to_pg_int_array(const TagSet& tags) {
+    std::string s = "{";
+    tags.for_each([&s](int id) {
+        if (s.size() > 1)
+            s += ',';
+        s += std::to_string(id);
+    });
+    s += "}";
+    return s;
+}
+
+// float8[] → {0.5,1,9}（%.17g 保留完整精度），搭配 $n::float8[]
+inline std::string to_pg_float_array(const std::vector<double>& v) {
+    std::string s = "{";
+    char        buf[32];
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (i)
+            s += ',';
+        std::snprintf(buf, sizeof(buf), "%.17g", v[i]);
+        s += buf;
+    }
+    s += "}";
+    return s;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "statement_timings.hpp"
+#include "unit_of_work.hpp"
+
+// 直接嵌入 SQL 的運算式參數（不加引號），例如 currval(...)
+struct SqlExpr
+{
+    std::string sql;
+};
+
+/// Sends a batch of statements to PostgreSQL in one round trip (pqxx::pipeline)
+/// - prepared(name, args...) queues EXECUTE name(...) for a statement registered
+///   by register_prepared; query(sql) queues raw SQL
+/// - nothing is sent until flush(); the whole batch goes out as one message
+/// - standalone (Pipeline(conn)): the batch runs as one implicit transaction, so
+///   it either applies fully or not at all; Pipeline(uow) batches inside the
+///   unit of work's transaction instead and commits with it
+/// - later statements can refer to earlier ones only through the session
+///   (e.g. currval of a sequence), not through their results
+/// - after_commit(fn) runs once the batch is durable: right after flush() when
+///   standalone, after UnitOfWork::commit() otherwise
+class Pipeline
+{
+   public:
+    using Ticket = pqxx::pipeline::query_id;
+
+    explicit Pipeline(pqxx::connection& c)
+        : own_(std::in_place, c), tx_(*own_) {
+        open();
+    }
+
+    explicit Pipeline(UnitOfWork& uow) : tx_(uow.tx()), uow_(&uow) { open(); }
+
+    Pipeline(const Pipeline&)            = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    template <typename... Args>
+    Ticket prepared(const std::string& name, const Args&... args) {
+        std::string sql = "EXECUTE " + name;
+        if constexpr (sizeof...(Args) > 0) {
+            sql += '(';
+            bool first = true;
+            ((sql += (first ? "" : ", ") + literal(args), first = false), ...);
+            sql += ')';
+        }
+        return query(sql);
+    }
+
+    Ticket query(const std::string& sql) {
+        if (flushed_)
+            throw std::logic_error("Pipeline already flushed");
+        const Ticket t = pipe_->insert(sql);
+        tickets_.push_back(t);
+        return t;
+    }
+
+    void after_commit(std::function<void()> fn) {
+        if (uow_)
+            uow_->after_commit(std::move(fn));
+        else
+            hooks_.push_back(std::move(fn));
+    }
+
+    /// Send everything queued and collect every result; rethrows the first error
+    void flush() {
+        if (flushed_)
+            return;
+        flushed_      = true;
+        const auto t0 = std::chrono::steady_clock::now();
+        pipe_->complete();
+        for (auto t : tickets_) results_.emplace(t, pipe_->retrieve(t));
+        StatementTimings::instance().of("pipeline").record(
+            std::chrono::steady_clock::now() - t0);
+        // 關閉 pipeline 才能在同一個交易繼續執行語句或 commit
+        pipe_.reset();
+        for (auto& fn : hooks_) fn();
+    }
+
+    const pqxx::result& result(Ticket t) {
+        flush();
+        return results_.at(t);
+    }
+
+   private:
+    static constexpr int kRetainAll = 1 << 20; // 等 flush() 再一起送出
+
+    std::optional<pqxx::nontransaction> own_;
+    pqxx::transaction_base&             tx_;
+    UnitOfWork*                         uow_ = nullptr;
+    std::optional<pqxx::pipeline>       pipe_;
+    std::vector<Ticket>                 tickets_;
+    std::map<Ticket, pqxx::result>      results_;
+    std::vector<std::function<void()>>  hooks_;
+    bool                                flushed_ = false;
+
+    void open() {
+        pipe_.emplace(tx_);
+        pipe_->retain(kRetainAll);
+    }
+
+    std::string literal(const SqlExpr& e) { return e.sql; }
+
+    template <typename T>
+    std::string literal(const T& v) {
+        return tx_.quote(v);
+    }
+};
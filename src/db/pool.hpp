@@ -1,47 +1,120 @@
 #pragma once
 #include <pqxx/pqxx>
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
+#include "../util/histogram.hpp"
+#include "../util/log.hpp"
+#include "../util/periodic.hpp"
 
-/// Simple thread-safe PostgreSQL connection pool (pqxx)
-/// - Construct with connStr and pool size
+// 連線池大小與健康檢查策略（見 DbPool 說明）
+struct DbPoolOptions
+{
+    std::size_t               minSize = 2; // 啟動時平行開好，閒置回收不低於此數
+    std::size_t               maxSize = 8; // 不足時才在借出當下開新連線
+    std::chrono::milliseconds idleTtl{300000};       // 0 = 不回收閒置連線
+    std::chrono::milliseconds acquireTimeout{5000};  // 0 = acquire() 無限等待
+    std::chrono::milliseconds skipPingWithin{5000};  // 0 = 每次借出都 ping
+    std::chrono::milliseconds idlePingEvery{30000};  // 0 = 不做背景 ping
+    bool affinity = false; // 執行緒保留自己上次用的連線，借還不碰共用堆疊
+};
+
+/// Thrown by DbPool::acquire() when no connection frees up within acquireTimeout
+class DbPoolTimeout : public std::runtime_error
+{
+   public:
+    DbPoolTimeout() : std::runtime_error("db_pool_timeout") {}
+};
+
+/// Elastic thread-safe PostgreSQL connection pool (pqxx)
+/// - Construct with connStr and a fixed size, or with DbPoolOptions (min/max)
 /// - Optional initializer(conn) runs once per new connection (e.g., register
 /// prepared)
+/// - minSize connections are opened in parallel up front; beyond that, a caller
+///   that finds no idle connection opens its own (outside any lock) up to maxSize
+/// - Idle connections sit on a lock-free LIFO stack, so the most recently used one
+///   (warm socket, warm plan cache) goes out first; the mutex/cv is only used
+///   when a caller actually has to wait
+/// - affinity: a thread parks the connection it returns in a thread-local slot and
+///   takes it back on its next acquire without touching the stack. Waiters steal
+///   parked connections, and a release never parks while someone is waiting.
 /// - Acquire returns a RAII handle; on destruction it returns the connection to the
 /// pool
-/// - try_acquire(timeout) to avoid indefinite blocking
+/// - acquire() gives up after acquireTimeout with DbPoolTimeout (→ 503);
+///   try_acquire(timeout) returns an empty handle instead. Opening a new
+///   connection counts against the same deadline (libpq connect_timeout).
+/// - Health checks: a connection returned within skipPingWithin is handed out
+///   without a ping; older ones get one (SELECT 1, no transaction). If an unpinged
+///   connection turns out to be broken, Handle::run / DbPool::run reconnect and
+///   retry the handle's first statement once.
+/// - A background reaper closes connections idle for idleTtl (down to minSize)
+///   and pings the ones idle for idlePingEvery. It claims only those nodes, in
+///   place: the rest of the stack stays available, and a caller that pops a
+///   node the reaper is holding just moves on to the next one.
+/// - stats() exposes sizes, counters and the acquire wait-time histogram
 class DbPool
 {
    public:
     using Initializer = std::function<void(pqxx::connection&)>;
+    using clock       = std::chrono::steady_clock;
+    using Options     = DbPoolOptions;
+
+    struct Stats
+    {
+        std::size_t   open;    // 已開（含借出中與開啟中）
+        std::size_t   idle;    // 閒置可借（含 parked）
+        std::size_t   parked;  // 停在執行緒 affinity 槽位的閒置連線
+        std::size_t   waiting; // 正在等連線的呼叫者
+        std::size_t   minSize;
+        std::size_t   maxSize;
+        std::uint64_t acquires;        // 成功借出
+        std::uint64_t affinityHits;    // 直接取回自己 parked 的連線
+        std::uint64_t timeouts;        // 逾時（acquire 丟 DbPoolTimeout）
+        std::uint64_t opened;          // 累計新開連線
+        std::uint64_t evicted;         // 因閒置 TTL 關閉
+        std::uint64_t connectFailures; // 開連線失敗
+        LatencyHistogram::Snapshot wait; // 借出等待時間
+    };
 
+    /// Fixed-size pool (min = max = size); acquire() waits indefinitely
     DbPool(std::string connStr, std::size_t size = 8, Initializer init = nullptr)
-        : connStr_(std::move(connStr)), init_(std::move(init)), shutdown_(false) {
-        if (size == 0)
-            size = 1;
-        for (std::size_t i = 0; i < size; ++i) {
-            pool_.push(make_connection());
-        }
-        size_ = size;
+        : DbPool(std::move(connStr), fixed(size), std::move(init)) {}
+
+    DbPool(std::string connStr, Options opt, Initializer init = nullptr)
+        : connStr_(std::move(connStr)), init_(std::move(init)), opt_(opt) {
+        opt_.minSize = std::max<std::size_t>(1, opt_.minSize);
+        opt_.maxSize = std::max(opt_.minSize, opt_.maxSize);
+        nodes_       = std::make_unique<Node[]>(opt_.maxSize);
+        for (std::size_t i = opt_.maxSize; i-- > opt_.minSize;)
+            freeNodes_.push_back(static_cast<std::uint32_t>(i));
+        open_initial(opt_.minSize);
+        const auto every = reap_interval();
+        if (every.count() > 0)
+            reaper_.start(every, [this] { reap_idle(); });
     }
 
     DbPool(const DbPool&)            = delete;
     DbPool& operator=(const DbPool&) = delete;
 
     ~DbPool() {
+        reaper_.stop();
+        shutdown_.store(true);
         std::lock_guard<std::mutex> lk(m_);
-        shutdown_ = true;
-        while (!pool_.empty())
-            pool_.pop(); // unique_ptr destructors close connections
-        // no notify here; destructor is called at program end or when no threads
-        // should be waiting
+        cv_.notify_all();
+        // nodes_ 解構時關閉連線；destructor is called at program end or when no
+        // handles should be outstanding
     }
 
     /// RAII handle returned by acquire/try_acquire
@@ -49,16 +122,21 @@ class DbPool
     {
        public:
         Handle() = default;
-        Handle(DbPool* pool, std::unique_ptr<pqxx::connection> c)
-            : pool_(pool), conn_(std::move(c)) {}
+        Handle(DbPool* pool, std::uint32_t node, bool verified)
+            : pool_(pool), node_(node), conn_(pool->nodes_[node].conn.get()),
+              verified_(verified) {}
 
         Handle(Handle&& other) noexcept { *this = std::move(other); }
         Handle& operator=(Handle&& other) noexcept {
             if (this != &other) {
                 release();
                 pool_       = other.pool_;
-                conn_       = std::move(other.conn_);
+                node_       = other.node_;
+                conn_       = other.conn_;
+                verified_   = other.verified_;
+                used_       = other.used_;
                 other.pool_ = nullptr;
+                other.conn_ = nullptr;
             }
             return *this;
         }
@@ -69,110 +147,623 @@ class DbPool
         ~Handle() { release(); }
 
         pqxx::connection& operator*() { return *conn_; }
-        pqxx::connection* operator->() { return conn_.get(); }
-        pqxx::connection* get() const { return conn_.get(); }
-        explicit          operator bool() const { return static_cast<bool>(conn_); }
+        pqxx::connection* operator->() { return conn_; }
+        pqxx::connection* get() const { return conn_; }
+        explicit          operator bool() const { return conn_ != nullptr; }
+
+        /// Run fn(conn). If this is the handle's first run on a connection that
+        /// was handed out without a ping and it fails with broken_connection,
+        /// reconnect and run fn once more. A broken connection means fn's
+        /// transaction never committed, so fn should hold at most one write
+        /// transaction (reads before it are fine).
+        template <typename Fn>
+        decltype(auto) run(Fn&& fn) {
+            const bool mayRetry = !verified_ && !used_;
+            used_               = true;
+            try {
+                return fn(*conn_);
+            }
+            catch (const pqxx::broken_connection&) {
+                if (!mayRetry || !pool_)
+                    throw;
+            }
+            pool_->reconnect(*conn_);
+            verified_ = true;
+            return fn(*conn_);
+        }
 
         /// Manually return the connection to the pool (optional)
         void release() {
             if (pool_ && conn_) {
-                pool_->return_to_pool(std::move(conn_));
+                pool_->return_to_pool(node_);
                 pool_ = nullptr;
+                conn_ = nullptr;
             }
         }
 
        private:
-        DbPool*                           pool_ = nullptr;
-        std::unique_ptr<pqxx::connection> conn_{};
+        DbPool*           pool_     = nullptr;
+        std::uint32_t     node_     = 0;
+        pqxx::connection* conn_     = nullptr;
+        bool              verified_ = true;  // 借出時已 ping（或剛建立）
+        bool              used_     = false; // run() 是否已執行過
     };
 
-    /// Block until a connection is available; throws on shutdown
+    /// Wait up to acquireTimeout (forever if 0); throws DbPoolTimeout on timeout
+    /// and runtime_error on shutdown
     Handle acquire() {
-        std::unique_ptr<pqxx::connection> c;
-        {
-            std::unique_lock<std::mutex> lk(m_);
-            cv_.wait(lk, [&] { return shutdown_ || !pool_.empty(); });
-            if (shutdown_)
-                throw std::runtime_error("DbPool shutdown");
-            c = std::move(pool_.front());
-            pool_.pop();
-        }
-        ensure_alive(*c);
-        return Handle(this, std::move(c));
+        Outcome    out;
+        const auto deadline = clock::now() + opt_.acquireTimeout;
+        const bool bounded  = opt_.acquireTimeout.count() > 0;
+        Handle     h        = obtain(bounded ? &deadline : nullptr, out);
+        if (out == Outcome::Timeout)
+            throw DbPoolTimeout();
+        if (out == Outcome::Shutdown)
+            throw std::runtime_error("DbPool shutdown");
+        return h;
     }
 
     /// Try to acquire within timeout; returns empty handle on timeout
     template <typename Rep, typename Period>
     Handle try_acquire(const std::chrono::duration<Rep, Period>& timeout) {
-        std::unique_ptr<pqxx::connection> c;
-        {
-            std::unique_lock<std::mutex> lk(m_);
-            if (!cv_.wait_for(
-                    lk, timeout, [&] { return shutdown_ || !pool_.empty(); })) {
-                return {}; // timeout
-            }
-            if (shutdown_)
-                return {};
-            c = std::move(pool_.front());
-            pool_.pop();
-        }
-        ensure_alive(*c);
-        return Handle(this, std::move(c));
+        Outcome    out;
+        const auto deadline =
+            clock::now() + std::chrono::duration_cast<clock::duration>(timeout);
+        return obtain(&deadline, out);
+    }
+
+    /// acquire() + Handle::run(fn) for single-unit jobs
+    template <typename Fn>
+    decltype(auto) run(Fn&& fn) {
+        auto h = acquire();
+        return h.run(std::forward<Fn>(fn));
     }
 
-    std::size_t size() const { return size_; }
+    /// Currently open connections (idle + in use)
+    std::size_t size() const { return total_.load(std::memory_order_relaxed); }
+
+    Stats stats() const {
+        Stats st{};
+        st.open    = total_.load(std::memory_order_relaxed);
+        st.waiting = waiting_.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < opt_.maxSize; ++i) {
+            const auto s = nodes_[i].state.load(std::memory_order_relaxed);
+            st.idle += (s == kStacked || s == kParked) ? 1 : 0;
+            st.parked += s == kParked ? 1 : 0;
+        }
+        st.minSize         = opt_.minSize;
+        st.maxSize         = opt_.maxSize;
+        st.acquires        = acquires_.load(std::memory_order_relaxed);
+        st.affinityHits    = affinityHits_.load(std::memory_order_relaxed);
+        st.timeouts        = timeouts_.load(std::memory_order_relaxed);
+        st.opened          = opened_.load(std::memory_order_relaxed);
+        st.evicted         = evicted_.load(std::memory_order_relaxed);
+        st.connectFailures = connectFailures_.load(std::memory_order_relaxed);
+        st.wait            = waitHist_.snapshot();
+        return st;
+    }
 
    private:
+    static constexpr std::uint32_t kNil = 0xffffffffu;
+
+    // 節點狀態：Free 沒有連線；Lent 由單一持有者獨占（借出、開啟中、
+    // reaper 檢查中）；Stacked 在閒置堆疊上；Parked 停在某執行緒的 affinity 槽位
+    // reaper 原地認領（節點仍掛在堆疊上）：Reaping 檢查中；Detached 檢查中途被
+    // pop 摘下，reaper 做完要自己放回；Evicted 連線已關，等 pop 摘下後回收節點
+    enum : std::uint8_t
+    {
+        kFree,
+        kLent,
+        kStacked,
+        kParked,
+        kReaping,
+        kDetached,
+        kEvicted
+    };
+
+    // 每條連線固定佔一個節點；非 atomic 欄位只由目前獨占該節點者讀寫
+    struct Node
+    {
+        std::unique_ptr<pqxx::connection> conn;
+        clock::time_point                 lastUsed;    // 最近一次歸還（閒置 TTL 用）
+        clock::time_point                 lastChecked; // 最近一次確認連線仍正常
+        // 上面兩個時間換算成的到期點（steady_clock tick），reaper 不認領就能讀
+        std::atomic<clock::rep>           evictAt{0};
+        std::atomic<clock::rep>           pingAt{0};
+        std::atomic<std::uint8_t>         state{kFree};
+        std::atomic<std::uint32_t>        next{kNil}; // 閒置堆疊的下一個節點
+    };
+
+    struct Affinity
+    {
+        std::uint64_t poolId = 0;
+        std::uint32_t node   = kNil;
+    };
+
+    enum class Outcome
+    {
+        Ok,
+        Timeout,
+        Shutdown
+    };
+
     std::string connStr_;
     Initializer init_;
-    std::size_t size_{0};
+    Options     opt_;
+
+    std::unique_ptr<Node[]> nodes_;
+    // 閒置堆疊頂端：高 32 位元是版本號（防 ABA），低 32 位元是節點下標
+    std::atomic<std::uint64_t> top_{kNil};
+    std::atomic<std::size_t>   total_{0}; // 有連線的節點數（含開啟中）
+    std::atomic<std::size_t>   waiting_{0};
+    std::atomic<bool>          shutdown_{false};
+
+    std::mutex                 freeMu_;
+    std::vector<std::uint32_t> freeNodes_; // freeMu_ 保護
+
+    // 只在需要等待時使用
+    std::mutex              m_;
+    std::condition_variable cv_;
+    PeriodicWorker          reaper_;
+
+    inline static std::atomic<std::uint64_t> nextPoolId_{1};
+    const std::uint64_t id_ = nextPoolId_.fetch_add(1, std::memory_order_relaxed);
+
+    std::atomic<std::uint64_t> acquires_{0};
+    std::atomic<std::uint64_t> affinityHits_{0};
+    std::atomic<std::uint64_t> timeouts_{0};
+    std::atomic<std::uint64_t> opened_{0};
+    std::atomic<std::uint64_t> evicted_{0};
+    std::atomic<std::uint64_t> connectFailures_{0};
+    LatencyHistogram           waitHist_;
 
-    mutable std::mutex                            m_;
-    std::condition_variable                       cv_;
-    std::queue<std::unique_ptr<pqxx::connection>> pool_;
-    bool                                          shutdown_;
+    static Options fixed(std::size_t size) {
+        Options o;
+        o.minSize        = size;
+        o.maxSize        = size;
+        o.acquireTimeout = std::chrono::milliseconds(0);
+        return o;
+    }
+
+    // 每個執行緒一格；poolId 不符（別的池或已解構的池）就視為空
+    static Affinity& affinity_slot() {
+        thread_local Affinity a;
+        return a;
+    }
+
+    std::chrono::milliseconds reap_interval() const {
+        std::chrono::milliseconds every{0};
+        for (auto d : {opt_.idleTtl, opt_.idlePingEvery})
+            if (d.count() > 0 && (every.count() == 0 || d < every))
+                every = d;
+        return every.count() > 0 ? std::max(every, std::chrono::milliseconds(1000))
+                                 : every;
+    }
 
     std::unique_ptr<pqxx::connection> make_connection() {
-        auto c = std::make_unique<pqxx::connection>(connStr_);
+        return make_connection(connStr_);
+    }
+
+    std::unique_ptr<pqxx::connection> make_connection(const std::string& dsn) {
+        auto c = std::make_unique<pqxx::connection>(dsn);
         c->set_client_encoding("UTF8");
         // Health check
-        {
-            pqxx::work w(*c);
-            w.exec("SELECT 1");
-            w.commit();
-        }
+        ping(*c);
         if (init_)
             init_(*c);
         return c;
     }
 
+    // 每條連線各自握手（TLS/auth/initializer），平行開可把啟動時間壓到一條的量級
+    void open_initial(std::size_t n) {
+        std::vector<std::unique_ptr<pqxx::connection>> conns(n);
+        std::vector<std::exception_ptr>                errs(n);
+        std::vector<std::thread>                       ts;
+        ts.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            ts.emplace_back([&, i] {
+                try {
+                    conns[i] = make_connection();
+                }
+                catch (...) {
+                    errs[i] = std::current_exception();
+                }
+            });
+        }
+        for (auto& t : ts) t.join();
+        for (auto& e : errs)
+            if (e)
+                std::rethrow_exception(e);
+
+        const auto now = clock::now();
+        for (std::size_t i = 0; i < n; ++i) {
+            Node& nd       = nodes_[i];
+            nd.conn        = std::move(conns[i]);
+            nd.lastUsed    = now;
+            nd.lastChecked = now;
+            push(static_cast<std::uint32_t>(i));
+        }
+        total_.store(n);
+        opened_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // libpq 的 connect_timeout 以整秒計（無條件進位）；URI 與 key=value 兩種寫法
+    static std::string with_connect_timeout(const std::string& dsn,
+                                            clock::duration    left) {
+        const auto secs = std::chrono::ceil<std::chrono::seconds>(left).count();
+        const bool uri =
+            dsn.rfind("postgres", 0) == 0 && dsn.find("://") != std::string::npos;
+        const bool  query = dsn.find('?') != std::string::npos;
+        const char* sep   = !uri ? " " : query ? "&" : "?";
+        return dsn + sep + "connect_timeout=" + std::to_string(secs);
+    }
+
+    // 一個 round trip；不開交易（pqxx::work 會多送 BEGIN/COMMIT）
+    static void ping(pqxx::connection& c) {
+        pqxx::nontransaction n(c);
+        n.exec("SELECT 1");
+    }
+
+    // 由持有者在公開節點（放回堆疊、park）前呼叫
+    void schedule(Node& nd) const {
+        constexpr auto never = std::numeric_limits<clock::rep>::max();
+        auto           due   = [](clock::time_point t, std::chrono::milliseconds d) {
+            return d.count() > 0 ? (t + d).time_since_epoch().count() : never;
+        };
+        nd.evictAt.store(due(nd.lastUsed, opt_.idleTtl), std::memory_order_relaxed);
+        nd.pingAt.store(due(nd.lastChecked, opt_.idlePingEvery),
+                        std::memory_order_relaxed);
+    }
+
+    // ---- 閒置堆疊（Treiber stack，LIFO）----
+    void push(std::uint32_t n) {
+        schedule(nodes_[n]);
+        nodes_[n].state.store(kStacked, std::memory_order_release);
+        std::uint64_t top = top_.load(std::memory_order_relaxed);
+        for (;;) {
+            nodes_[n].next.store(static_cast<std::uint32_t>(top),
+                                 std::memory_order_relaxed);
+            const std::uint64_t want = (((top >> 32) + 1) << 32) | n;
+            if (top_.compare_exchange_weak(top, want))
+                return;
+        }
+    }
+
+    bool pop(std::uint32_t& n) {
+        std::uint64_t top = top_.load();
+        for (;;) {
+            const auto idx = static_cast<std::uint32_t>(top);
+            if (idx == kNil)
+                return false;
+            // idx 可能同時被別人取走再放回；版本號讓這次 CAS 失敗重來
+            const std::uint32_t next =
+                nodes_[idx].next.load(std::memory_order_relaxed);
+            const std::uint64_t want = (((top >> 32) + 1) << 32) | next;
+            if (!top_.compare_exchange_weak(top, want))
+                continue;
+            if (take_unlinked(idx)) {
+                n = idx;
+                return true;
+            }
+            top = top_.load(); // reaper 手上的節點：跳過，繼續往下拿
+        }
+    }
+
+    // 剛從堆疊摘下 idx：平常直接拿走；reaper 正在檢查就交給它放回；
+    // 已被它關掉連線的就回收節點
+    bool take_unlinked(std::uint32_t idx) {
+        auto&        st = nodes_[idx].state;
+        std::uint8_t s  = st.load(std::memory_order_acquire);
+        for (;;) {
+            if (s == kEvicted) {
+                recycle(idx);
+                return false;
+            }
+            const std::uint8_t want = s == kStacked ? kLent : kDetached;
+            if (st.compare_exchange_weak(s, want, std::memory_order_acq_rel))
+                return want == kLent;
+        }
+    }
+
+    // 從其他執行緒的 affinity 槽位搶一條（堆疊空時）
+    bool steal(std::uint32_t& n) {
+        for (std::uint32_t i = 0; i < opt_.maxSize; ++i) {
+            std::uint8_t expect = kParked;
+            if (nodes_[i].state.compare_exchange_strong(expect, kLent)) {
+                n = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 佔一個名額與節點；成功後由呼叫者在鎖外開連線
+    bool try_reserve(std::uint32_t& n) {
+        std::size_t cur = total_.load(std::memory_order_relaxed);
+        do {
+            if (cur >= opt_.maxSize)
+                return false;
+        } while (!total_.compare_exchange_weak(cur, cur + 1));
+        std::lock_guard<std::mutex> lk(freeMu_);
+        if (freeNodes_.empty()) {
+            total_.fetch_sub(1); // 被回收的節點還掛在堆疊上，等 pop 摘下
+            return false;
+        }
+        n = freeNodes_.back();
+        freeNodes_.pop_back();
+        nodes_[n].state.store(kLent, std::memory_order_relaxed);
+        return true;
+    }
+
+    void free_node(std::uint32_t n) {
+        nodes_[n].conn.reset();
+        total_.fetch_sub(1);
+        recycle(n);
+        wake_waiter();
+    }
+
+    // 已沒有連線（也不在堆疊上）的節點還給 freeNodes_；不叫醒等待者（pop 可能
+    // 正拿著 m_），由呼叫者決定
+    void recycle(std::uint32_t n) {
+        nodes_[n].state.store(kFree, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(freeMu_);
+        freeNodes_.push_back(n);
+    }
+
+    void wake_waiter() {
+        if (waiting_.load() == 0)
+            return;
+        std::lock_guard<std::mutex> lk(m_);
+        cv_.notify_one();
+    }
+
+    // deadline 為 nullptr 表示無限等待
+    Handle obtain(const clock::time_point* deadline, Outcome& out) {
+        const auto t0 = clock::now();
+
+        // 快速路徑：取回本執行緒上次 parked 的連線
+        if (opt_.affinity) {
+            Affinity& a = affinity_slot();
+            if (a.poolId == id_ && a.node != kNil) {
+                const std::uint32_t mine   = a.node;
+                std::uint8_t        expect = kParked;
+                a.node                     = kNil;
+                if (nodes_[mine].state.compare_exchange_strong(expect, kLent)) {
+                    affinityHits_.fetch_add(1, std::memory_order_relaxed);
+                    out = Outcome::Ok;
+                    note_acquired(t0);
+                    return checkout(mine);
+                }
+            }
+        }
+
+        std::uint32_t                n = kNil;
+        std::unique_lock<std::mutex> lk(m_, std::defer_lock);
+        for (;;) {
+            if (shutdown_.load()) {
+                out = Outcome::Shutdown;
+                break;
+            }
+            if (pop(n) || (opt_.affinity && steal(n))) {
+                out = Outcome::Ok;
+                break;
+            }
+            if (try_reserve(n)) {
+                if (lk.owns_lock()) {
+                    waiting_.fetch_sub(1);
+                    lk.unlock();
+                }
+                return open_reserved(n, deadline, t0, out);
+            }
+            if (!lk.owns_lock()) {
+                // 先登記等待再重查一次；歸還端先放回再看 waiting_，兩邊不會互相錯過
+                lk.lock();
+                waiting_.fetch_add(1);
+                continue;
+            }
+            if (!deadline) {
+                cv_.wait(lk);
+            }
+            else if (cv_.wait_until(lk, *deadline) == std::cv_status::timeout) {
+                if (pop(n) || (opt_.affinity && steal(n))) {
+                    out = Outcome::Ok;
+                    break;
+                }
+                lk.unlock();
+                waiting_.fetch_sub(1);
+                return timed_out(t0, out);
+            }
+        }
+        if (lk.owns_lock()) {
+            waiting_.fetch_sub(1);
+            lk.unlock();
+        }
+        if (out != Outcome::Ok)
+            return {};
+        note_acquired(t0);
+        return checkout(n);
+    }
+
+    // 新連線也受 acquire 期限約束：剩下的時間交給 libpq connect_timeout
+    Handle open_reserved(std::uint32_t            n,
+                         const clock::time_point* deadline,
+                         clock::time_point        t0,
+                         Outcome&                 out) {
+        const std::string* dsn = &connStr_;
+        std::string        bounded;
+        if (deadline) {
+            const auto left = *deadline - clock::now();
+            if (left <= clock::duration::zero()) {
+                free_node(n);
+                return timed_out(t0, out);
+            }
+            bounded = with_connect_timeout(connStr_, left);
+            dsn     = &bounded;
+        }
+        try {
+            nodes_[n].conn = make_connection(*dsn);
+        }
+        catch (...) {
+            connectFailures_.fetch_add(1, std::memory_order_relaxed);
+            free_node(n);
+            if (deadline && clock::now() >= *deadline)
+                return timed_out(t0, out);
+            throw;
+        }
+        opened_.fetch_add(1, std::memory_order_relaxed);
+        nodes_[n].lastChecked = clock::now();
+        out                   = Outcome::Ok;
+        note_acquired(t0);
+        return Handle(this, n, true);
+    }
+
+    Handle timed_out(clock::time_point t0, Outcome& out) {
+        timeouts_.fetch_add(1, std::memory_order_relaxed);
+        waitHist_.record(clock::now() - t0);
+        out = Outcome::Timeout;
+        return {};
+    }
+
+    void note_acquired(clock::time_point t0) {
+        acquires_.fetch_add(1, std::memory_order_relaxed);
+        waitHist_.record(clock::now() - t0);
+    }
+
+    Handle checkout(std::uint32_t n) {
+        Node&      nd     = nodes_[n];
+        const bool recent = opt_.skipPingWithin.count() > 0 &&
+                            clock::now() - nd.lastChecked < opt_.skipPingWithin;
+        if (recent && nd.conn->is_open())
+            return Handle(this, n, false);
+        try {
+            ensure_alive(*nd.conn);
+        }
+        catch (...) {
+            nd.lastChecked = clock::time_point{};
+            push(n); // 不讓池子縮水
+            wake_waiter();
+            throw;
+        }
+        nd.lastChecked = clock::now();
+        return Handle(this, n, true);
+    }
+
+    void reconnect(pqxx::connection& c) {
+        auto nc = make_connection();
+        // Replace object by moving new connection into place.
+        c = std::move(*nc);
+        opened_.fetch_add(1, std::memory_order_relaxed);
+    }
+
     void ensure_alive(pqxx::connection& c) {
         // If connection is closed/broken, recreate it.
         if (!c.is_open()) {
-            auto nc = make_connection();
-            // Replace object by moving new connection into place.
-            c = std::move(*nc);
+            reconnect(c);
             return;
         }
         // Lightweight ping; recreate if it fails
         try {
-            pqxx::work w(c);
-            w.exec("SELECT 1");
-            w.commit();
+            ping(c);
         }
         catch (...) {
-            auto nc = make_connection();
-            c       = std::move(*nc);
+            reconnect(c);
         }
     }
 
-    void return_to_pool(std::unique_ptr<pqxx::connection> c) {
-        if (!c)
+    // reaper：只認領到期的閒置節點。堆疊上的原地改成 Reaping（仍掛在堆疊上，
+    // 其他節點照常借出），parked 的直接搶走；由冷到熱關掉閒置超過 idleTtl 的
+    // （不低於 minSize），ping 閒置超過 idlePingEvery 的
+    void reap_idle() {
+        struct Claim
+        {
+            std::uint32_t node;
+            bool          inPlace; // 認領時在堆疊上
+        };
+        const auto         now  = clock::now();
+        const auto         tick = now.time_since_epoch().count();
+        std::vector<Claim> held;
+        for (std::uint32_t i = 0; i < opt_.maxSize; ++i) {
+            Node&        nd      = nodes_[i];
+            const auto   evictAt = nd.evictAt.load(std::memory_order_relaxed);
+            const bool   evict   = total_.load() > opt_.minSize && evictAt <= tick;
+            const bool   pingDue = nd.pingAt.load(std::memory_order_relaxed) <= tick;
+            std::uint8_t s       = nd.state.load(std::memory_order_relaxed);
+            if (!(evict || pingDue) || (s != kStacked && s != kParked))
+                continue;
+            const std::uint8_t to = s == kStacked ? kReaping : kLent;
+            if (nd.state.compare_exchange_strong(s, to, std::memory_order_acq_rel))
+                held.push_back({i, to == kReaping});
+        }
+
+        std::sort(held.begin(), held.end(), [&](const Claim& a, const Claim& b) {
+            return nodes_[a.node].lastUsed < nodes_[b.node].lastUsed;
+        });
+        for (auto const& c : held) {
+            Node& nd = nodes_[c.node];
+            if (opt_.idleTtl.count() > 0 && now - nd.lastUsed >= opt_.idleTtl &&
+                total_.load() > opt_.minSize) {
+                nd.conn.reset();
+                total_.fetch_sub(1);
+                evicted_.fetch_add(1, std::memory_order_relaxed);
+                finish_reap(c.node, c.inPlace, kEvicted);
+                continue;
+            }
+            if (opt_.idlePingEvery.count() > 0 &&
+                now - nd.lastChecked >= opt_.idlePingEvery) {
+                try {
+                    ensure_alive(*nd.conn);
+                    nd.lastChecked = clock::now();
+                }
+                catch (const std::exception& e) {
+                    // 重連失敗：保留舊物件，借出時再處理
+                    TP_LOG_WARN("db pool idle ping failed",
+                                log_kv("error", e.what()));
+                }
+            }
+            finish_reap(c.node, c.inPlace, kStacked);
+        }
+        if (!held.empty())
+            wake_waiter();
+    }
+
+    // 原地認領的節點若還沒被 pop 摘下，改狀態就好；否則照一般流程放回或回收
+    void finish_reap(std::uint32_t n, bool inPlace, std::uint8_t to) {
+        if (to == kStacked)
+            schedule(nodes_[n]);
+        std::uint8_t expect = kReaping;
+        if (inPlace && nodes_[n].state.compare_exchange_strong(
+                           expect, to, std::memory_order_acq_rel))
             return;
-        std::lock_guard<std::mutex> lk(m_);
-        if (shutdown_)
-            return; // dropping on shutdown
-        pool_.push(std::move(c));
-        cv_.notify_one();
+        if (to == kStacked)
+            push(n);
+        else
+            recycle(n);
+    }
+
+    void return_to_pool(std::uint32_t n) {
+        Node& nd = nodes_[n];
+        // 斷線的連線不記確認時間，下次借出必定重新檢查
+        const auto now = clock::now();
+        nd.lastUsed    = now;
+        nd.lastChecked = nd.conn->is_open() ? now : clock::time_point{};
+
+        if (opt_.affinity) {
+            Affinity& a = affinity_slot();
+            if (a.poolId != id_ || a.node == kNil ||
+                nodes_[a.node].state.load() != kParked) {
+                a = {id_, n};
+                schedule(nd);
+                // 先 park 再看 waiting_（與等待端「先登記再 steal」配對）
+                nd.state.store(kParked);
+                if (waiting_.load() == 0)
+                    return;
+                std::uint8_t expect = kParked;
+                if (!nd.state.compare_exchange_strong(expect, kLent))
+                    return; // 已被等待者搶走
+                a.node = kNil;
+            }
+        }
+        push(n);
+        wake_waiter();
     }
 };
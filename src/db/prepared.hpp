@@ -1,7 +1,86 @@
 #pragma once
 #include <pqxx/pqxx>
+#include <string>
 
-inline void register_prepared(pqxx::connection& c) {
+// suggest_similar 的執行方式（啟動時由 detect_similarity_plan 決定）
+// Scan：similarity() > $2 當過濾條件，每次循序掃 tasks
+// TrgmIndex：LOWER(description) % LOWER($1) 可走 GIN 索引，再以 > $2 複查
+enum class SimilarityPlan
+{
+    Scan,
+    TrgmIndex
+};
+
+// pg_trgm 已安裝且 tasks 上有 gin (LOWER(description) gin_trgm_ops) 索引時用 %
+inline SimilarityPlan detect_similarity_plan(pqxx::connection& c) {
+    pqxx::nontransaction tx(c);
+    auto                 r = tx.exec(
+        R"(SELECT EXISTS (SELECT 1 FROM pg_extension WHERE extname = 'pg_trgm')
+          AND EXISTS (SELECT 1
+                      FROM   pg_indexes
+                      WHERE  tablename  = 'tasks'
+                        AND  schemaname = ANY (current_schemas(false))
+                        AND  indexdef ILIKE '%USING gin%lower(description)%gin_trgm_ops%')
+          AS ok)");
+    return r[0]["ok"].as<bool>() ? SimilarityPlan::TrgmIndex : SimilarityPlan::Scan;
+}
+
+// % 運算子的門檻是 session 設定（>=），每條連線建立時設一次
+inline void set_similarity_threshold(pqxx::connection& c, double threshold) {
+    pqxx::nontransaction tx(c);
+    tx.exec("SET pg_trgm.similarity_threshold = " + tx.quote(threshold));
+}
+
+// recommend_query 的 SQL；權重以字面值或參數佔位（如 "$4::float8"）代入
+// base/mean：tag_fit 的組成；tag/time/quality/popularity：final_score 的組成
+inline std::string recommend_sql(const std::string& base,
+                                 const std::string& mean,
+                                 const std::string& tag,
+                                 const std::string& time,
+                                 const std::string& quality,
+                                 const std::string& popularity) {
+    return R"(WITH picked AS (
+         SELECT UNNEST($1::int[]) AS tag_id
+       ),
+       fits AS (
+         SELECT ttw.task_id,
+                AVG()" + base + "*ttw.base_weight + " + mean +
+           R"(*(ttw.alpha/NULLIF(ttw.alpha+ttw.beta,0))) AS tag_fit
+         FROM   task_tag_weight ttw
+         JOIN   picked p ON p.tag_id = ttw.tag_id
+         GROUP  BY ttw.task_id
+       ),
+       scored AS (
+         SELECT t.id,
+                t.description,
+                t.suggested_time,
+                t.created_at,
+                COALESCE(f.tag_fit, 0.1)           AS tag_fit,
+                CASE WHEN $3::int <= 0 OR t.suggested_time <= 0 THEN 0.8::float8
+                     ELSE EXP(-ABS(LN(($3::float8 + 1e-6) / (t.suggested_time + 1e-6))))
+                END                                AS time_fit,
+                COALESCE(ts.score_quality, 0.0)    AS score_quality,
+                COALESCE(ts.score_popularity, 0.0) AS score_popularity
+         FROM   tasks t
+         LEFT   JOIN fits       f  ON f.task_id  = t.id
+         LEFT   JOIN task_stats ts ON ts.task_id = t.id
+       )
+       SELECT id,
+              description,
+              suggested_time,
+              tag_fit,
+              time_fit,
+              score_quality,
+              score_popularity,
+              )" + tag + "*tag_fit + " + time + "*time_fit + " + quality +
+           "*score_quality + " + popularity + R"(*score_popularity AS final_score
+       FROM   scored
+       ORDER  BY final_score DESC, created_at DESC, id DESC
+       LIMIT  $2)";
+}
+
+inline void register_prepared(pqxx::connection& c,
+                              SimilarityPlan    plan = SimilarityPlan::Scan) {
     auto prepare_once = [&](const char* name, const char* sql) {
         try {
             c.prepare(name, sql);
@@ -10,9 +89,21 @@ inline void register_prepared(pqxx::connection& c) {
         }
     };
 
-    // 相似檢索（pg_trgm）
-    prepare_once("suggest_similar",
-                 R"(SELECT id,
+    // 相似檢索（pg_trgm）；兩種寫法參數與結果相同
+    // TrgmIndex：% 依 session 門檻（set_similarity_threshold）用索引取候選，
+    // 門檻需 <= $2；嚴格的 > $2 仍由第二個條件複查
+    if (plan == SimilarityPlan::TrgmIndex)
+        prepare_once("suggest_similar",
+                     R"(SELECT id,
+              similarity(LOWER(description), LOWER($1)) AS sim
+       FROM   tasks
+       WHERE  LOWER(description) % LOWER($1)
+         AND  similarity(LOWER(description), LOWER($1)) > $2
+       ORDER  BY sim DESC
+       LIMIT  $3)");
+    else
+        prepare_once("suggest_similar",
+                     R"(SELECT id,
               similarity(LOWER(description), LOWER($1)) AS sim
        FROM   tasks
        WHERE  similarity(LOWER(description), LOWER($1)) > $2
@@ -27,15 +118,54 @@ inline void register_prepared(pqxx::connection& c) {
        ON CONFLICT ("suggestion_id")
        DO UPDATE SET "task_id"=$2, similarity=$3, matched_at=now())");
 
-    // 採用事件：task_tag_weight upsert（snake_case）
+    // 採用事件：task_tag_weight 整批 upsert（$2 = int[]，一次 round trip）
     prepare_once(
         "tasktag_upsert_adopt",
         R"(INSERT INTO task_tag_weight (task_id, tag_id, base_weight, alpha, beta)
-       VALUES ($1,$2,0.5,1.0,9.0)
+       SELECT $1, tag_id, 0.5, 1.0, 9.0
+       FROM   (SELECT DISTINCT UNNEST($2::int[]) AS tag_id) picked
        ON CONFLICT (task_id, tag_id)
        DO UPDATE SET alpha = task_tag_weight.alpha + 1.0,
                      updated_at = now())");
 
+    // 略過/曝光事件：beta += 1（整批，同上）
+    prepare_once(
+        "tasktag_upsert_skip",
+        R"(INSERT INTO task_tag_weight (task_id, tag_id, base_weight, alpha, beta)
+       SELECT $1, tag_id, 0.5, 1.0, 9.0
+       FROM   (SELECT DISTINCT UNNEST($2::int[]) AS tag_id) picked
+       ON CONFLICT (task_id, tag_id)
+       DO UPDATE SET beta = task_tag_weight.beta + 1.0,
+                     updated_at = now())");
+
+    // 整批套用合併後的 alpha/beta 增量（非同步事件寫入）
+    // $1 task_id[], $2 tag_id[], $3 d_alpha[], $4 d_beta[],
+    // $5 insert_alpha[], $6 insert_beta[]（列不存在時的初始值，與單筆 upsert 同義）
+    // 單一 INSERT ... ON CONFLICT DO UPDATE：同時有別的交易建立同一列時，
+    // 會等它 commit 後改走 UPDATE，增量不會遺失；同一批內 (task_id, tag_id) 不重複
+    prepare_once("tasktag_apply_deltas",
+                 R"(WITH d AS (
+         SELECT *
+         FROM   UNNEST($1::int[], $2::int[], $3::float8[], $4::float8[],
+                       $5::float8[], $6::float8[])
+                AS d(task_id, tag_id, d_alpha, d_beta, insert_alpha, insert_beta)
+       )
+       INSERT INTO task_tag_weight (task_id, tag_id, base_weight, alpha, beta)
+       SELECT task_id, tag_id, 0.5, insert_alpha, insert_beta
+       FROM   d
+       ORDER  BY task_id, tag_id
+       ON CONFLICT (task_id, tag_id)
+       DO UPDATE SET
+         alpha      = task_tag_weight.alpha + (SELECT d.d_alpha
+                                                FROM   d
+                                                WHERE  d.task_id = EXCLUDED.task_id
+                                                  AND  d.tag_id  = EXCLUDED.tag_id),
+         beta       = task_tag_weight.beta + (SELECT d.d_beta
+                                              FROM   d
+                                              WHERE  d.task_id = EXCLUDED.task_id
+                                                AND  d.tag_id  = EXCLUDED.tag_id),
+         updated_at = now())");
+
     // 新增 suggestion（snake_case）
     prepare_once(
         "sugg_insert",
@@ -51,28 +181,14 @@ inline void register_prepared(pqxx::connection& c) {
        ON CONFLICT DO NOTHING)");
 
     // 推薦查詢（snake_case join）
-    prepare_once("recommend_query",
-                 R"(WITH picked AS (
-         SELECT UNNEST($1::int[]) AS tag_id
-       ),
-       fits AS (
-         SELECT t.id AS task_id,
-                AVG(0.4*ttw.base_weight + 0.6*(ttw.alpha/NULLIF(ttw.alpha+ttw.beta,0))) AS tag_fit
-         FROM   tasks t
-         JOIN   task_tag_weight ttw ON ttw.task_id = t.id
-         JOIN   picked p           ON p.tag_id     = ttw.tag_id
-         GROUP  BY t.id
-       )
-       SELECT t.id,
-              t.description,
-              t.suggested_time,
-              COALESCE(f.tag_fit, 0.1)          AS tag_fit,
-              COALESCE(ts.score_quality, 0.0)   AS score_quality,
-              COALESCE(ts.score_popularity, 0.0)AS score_popularity,
-              t.created_at
-       FROM   tasks t
-       LEFT   JOIN fits       f  ON f.task_id  = t.id
-       LEFT   JOIN task_stats ts ON ts.task_id = t.id
-       ORDER  BY t.created_at DESC
-       LIMIT  $2)");
+    // $1 tag ids, $2 limit(K), $3 使用者時間（分鐘）
+    // 先算 final_score 再 ORDER BY ... LIMIT，只回傳 K 筆（time_fit 與 C++ 端同式）
+    // 預設權重寫成字面值；_weighted 版本的權重從 $4..$9 帶入（RankingWeights）
+    const std::string fixedSql =
+        recommend_sql("0.4", "0.6", "0.55", "0.25", "0.12", "0.08");
+    const std::string weightedSql = recommend_sql(
+        "$8::float8", "$9::float8", "$4::float8", "$5::float8", "$6::float8",
+        "$7::float8");
+    prepare_once("recommend_query", fixedSql.c_str());
+    prepare_once("recommend_query_weighted", weightedSql.c_str());
 }
@@ -0,0 +1,85 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "../util/histogram.hpp"
+
+/// Latency of each prepared statement, keyed by its registered name
+/// - a fixed table: a name is added on its first execution (under a mutex) and
+///   found afterwards with a lock-free scan, which is noise next to the round
+///   trip being timed
+/// - names past kMaxStatements share the "other" entry
+/// - pipelined batches are timed as a whole under "pipeline"
+class StatementTimings
+{
+   public:
+    static constexpr std::size_t kMaxStatements = 64;
+
+    static StatementTimings& instance() {
+        static StatementTimings t;
+        return t;
+    }
+
+    LatencyHistogram& of(std::string_view name) {
+        if (auto* h = find(name))
+            return *h;
+        std::lock_guard<std::mutex> lk(mu_);
+        if (auto* h = find(name))
+            return *h;
+        const std::size_t n = size_.load(std::memory_order_relaxed);
+        if (n == kMaxStatements)
+            return other_;
+        entries_[n].name = std::string(name);
+        size_.store(n + 1, std::memory_order_release);
+        return entries_[n].hist;
+    }
+
+    // fn(name, const LatencyHistogram&)
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        const std::size_t n = size_.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < n; ++i) fn(entries_[i].name, entries_[i].hist);
+        if (other_.snapshot().count > 0)
+            fn(std::string("other"), other_);
+    }
+
+   private:
+    struct Entry
+    {
+        std::string      name;
+        LatencyHistogram hist;
+    };
+
+    std::array<Entry, kMaxStatements> entries_;
+    std::atomic<std::size_t>          size_{0};
+    std::mutex                        mu_;
+    LatencyHistogram                  other_;
+
+    StatementTimings() = default;
+
+    LatencyHistogram* find(std::string_view name) {
+        const std::size_t n = size_.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < n; ++i)
+            if (entries_[i].name == name)
+                return &entries_[i].hist;
+        return nullptr;
+    }
+};
+
+// exec_prepared 並把耗時記在該 statement 名下（失敗的執行不計）
+template <typename... Args>
+pqxx::result exec_prepared_timed(pqxx::transaction_base& tx,
+                                 const char*             name,
+                                 Args&&... args) {
+    const auto   t0 = std::chrono::steady_clock::now();
+    pqxx::result r  = tx.exec_prepared(name, std::forward<Args>(args)...);
+    StatementTimings::instance().of(name).record(std::chrono::steady_clock::now() -
+                                                 t0);
+    return r;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/// One pqxx::work shared by several repositories so a use case commits once
+/// - repositories take UnitOfWork& overloads and run their statements on tx()
+/// - side effects that must only happen after a durable write (e.g. mirroring
+///   deltas into the resident index) go through after_commit(fn)
+/// - destroying an uncommitted unit rolls the transaction back and drops hooks
+class UnitOfWork
+{
+   public:
+    explicit UnitOfWork(pqxx::connection& c) : tx_(c) {}
+
+    UnitOfWork(const UnitOfWork&)            = delete;
+    UnitOfWork& operator=(const UnitOfWork&) = delete;
+
+    pqxx::work& tx() { return tx_; }
+
+    void after_commit(std::function<void()> fn) { hooks_.push_back(std::move(fn)); }
+
+    void commit() {
+        tx_.commit();
+        auto hooks = std::move(hooks_);
+        hooks_.clear();
+        for (auto& fn : hooks) fn();
+    }
+
+   private:
+    pqxx::work                         tx_;
+    std::vector<std::function<void()>> hooks_;
+};
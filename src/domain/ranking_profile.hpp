@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+
+// 預設權重（與 recommend_query 的常數相同）；編譯期常數，供特化的快速路徑使用
+struct DefaultRanking
+{
+    static constexpr double tag        = 0.55;
+    static constexpr double time       = 0.25;
+    static constexpr double quality    = 0.12;
+    static constexpr double popularity = 0.08;
+    static constexpr double base       = 0.4; // tag_fit 裡 base_weight 的比重
+    static constexpr double mean       = 0.6; // tag_fit 裡 Beta 平均的比重
+};
+
+// final_score = tag*tagFit + time*timeFit + quality*q + popularity*p
+// tagFit      = AVG(base*base_weight + mean*alpha/(alpha+beta))
+struct RankingWeights
+{
+    double tag        = DefaultRanking::tag;
+    double time       = DefaultRanking::time;
+    double quality    = DefaultRanking::quality;
+    double popularity = DefaultRanking::popularity;
+    double base       = DefaultRanking::base;
+    double mean       = DefaultRanking::mean;
+
+    bool operator==(const RankingWeights& o) const {
+        return tag == o.tag && time == o.time && quality == o.quality &&
+               popularity == o.popularity && base == o.base && mean == o.mean;
+    }
+    bool operator!=(const RankingWeights& o) const { return !(*this == o); }
+
+    bool is_default() const { return *this == RankingWeights{}; }
+
+    // 依名稱設定單一權重；未知名稱或非有限、負值時回 false
+    bool set(const std::string& key, double v) {
+        if (!std::isfinite(v) || v < 0.0)
+            return false;
+        if (key == "tag")
+            tag = v;
+        else if (key == "time")
+            time = v;
+        else if (key == "quality")
+            quality = v;
+        else if (key == "popularity")
+            popularity = v;
+        else if (key == "base")
+            base = v;
+        else if (key == "mean")
+            mean = v;
+        else
+            return false;
+        return true;
+    }
+
+    /// "tag=0.6,time=0.2,..."; unspecified weights keep their current value
+    bool parse(const std::string& spec, std::string& err) {
+        std::stringstream ss(spec);
+        std::string       item;
+        while (std::getline(ss, item, ',')) {
+            if (item.find_first_not_of(" \t") == std::string::npos)
+                continue;
+            const auto eq = item.find('=');
+            if (eq == std::string::npos) {
+                err = "expected key=value: " + item;
+                return false;
+            }
+            auto trim = [](std::string s) {
+                s.erase(0, s.find_first_not_of(" \t"));
+                s.erase(s.find_last_not_of(" \t") + 1);
+                return s;
+            };
+            const std::string key = trim(item.substr(0, eq));
+            const std::string val = trim(item.substr(eq + 1));
+            char*             end = nullptr;
+            const double      v   = std::strtod(val.c_str(), &end);
+            if (val.empty() || *end != '\0' || !set(key, v)) {
+                err = "invalid weight: " + item;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct RankingProfile
+{
+    std::string    name = "default";
+    RankingWeights weights;
+    std::uint64_t  version = 0; // 每次換 profile 遞增，推薦快取的 key 會帶上
+};
+
+/// Process-wide active ranking profile, swappable at runtime (A/B experiments)
+/// - readers take a shared_ptr snapshot (atomic load, acquire) and never lock;
+///   swap() publishes a new immutable profile with a single atomic store
+/// - a replaced profile is freed once the last request holding its snapshot
+///   finishes; hold the snapshot, not a reference into it, for the request
+class RankingProfileStore
+{
+   public:
+    using Snapshot = std::shared_ptr<const RankingProfile>;
+
+    explicit RankingProfileStore(std::string    name = "default",
+                                 RankingWeights w    = {}) {
+        swap(std::move(name), w);
+    }
+
+    RankingProfileStore(const RankingProfileStore&)            = delete;
+    RankingProfileStore& operator=(const RankingProfileStore&) = delete;
+
+    Snapshot current() const {
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    Snapshot swap(std::string name, RankingWeights w) {
+        std::lock_guard<std::mutex> lk(mu_); // 讓 version 與發布順序一致
+        auto                        p = std::make_shared<RankingProfile>();
+        p->name                       = std::move(name);
+        p->weights                    = w;
+        p->version                    = ++version_;
+        Snapshot snap                 = std::move(p);
+        std::atomic_store_explicit(&current_, snap, std::memory_order_release);
+        return snap;
+    }
+
+   private:
+    Snapshot      current_;
+    std::mutex    mu_;
+    std::uint64_t version_ = 0;
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Set of tag_dim ids: a fixed-width bitset with a sorted overflow vector
+/// - ids 1..kInlineBits-1 live in Mask (four 64-bit words), which covers the
+///   whole catalog today; larger ids go to the overflow path
+/// - ids <= 0 never exist in tag_dim and are dropped on insert
+/// - duplicates collapse on insert, so tags + tagCodes can be merged blindly
+/// - intersect_count(mask) is a popcount over four words; hash() is over the
+///   words plus the overflow ids
+class TagSet
+{
+   public:
+    static constexpr int kWords      = 4;
+    static constexpr int kInlineBits = kWords * 64;
+
+    using Mask = std::array<std::uint64_t, kWords>;
+
+    TagSet() = default;
+
+    static TagSet of(const std::vector<int>& ids) {
+        TagSet s;
+        for (int id : ids) s.insert(id);
+        return s;
+    }
+
+    static bool is_inline(int id) { return id > 0 && id < kInlineBits; }
+
+    void insert(int id) {
+        if (id <= 0)
+            return;
+        if (is_inline(id)) {
+            bits_[id >> 6] |= std::uint64_t(1) << (id & 63);
+            return;
+        }
+        auto it = std::lower_bound(overflow_.begin(), overflow_.end(), id);
+        if (it == overflow_.end() || *it != id)
+            overflow_.insert(it, id);
+    }
+
+    void insert(const std::vector<int>& ids) {
+        for (int id : ids) insert(id);
+    }
+
+    bool contains(int id) const {
+        if (is_inline(id))
+            return (bits_[id >> 6] >> (id & 63)) & 1;
+        return std::binary_search(overflow_.begin(), overflow_.end(), id);
+    }
+
+    std::size_t size() const {
+        std::size_t n = overflow_.size();
+        for (auto w : bits_) n += static_cast<std::size_t>(__builtin_popcountll(w));
+        return n;
+    }
+
+    bool empty() const { return size() == 0; }
+    bool has_overflow() const { return !overflow_.empty(); }
+
+    const Mask&             mask() const { return bits_; }
+    const std::vector<int>& overflow() const { return overflow_; }
+
+    /// |this ∩ other| restricted to inline ids
+    std::size_t intersect_count(const Mask& other) const {
+        std::size_t n = 0;
+        for (int w = 0; w < kWords; ++w)
+            n += static_cast<std::size_t>(__builtin_popcountll(bits_[w] & other[w]));
+        return n;
+    }
+
+    /// Ascending ids
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (int w = 0; w < kWords; ++w) {
+            for (std::uint64_t b = bits_[w]; b; b &= b - 1)
+                fn(w * 64 + __builtin_ctzll(b));
+        }
+        for (int id : overflow_) fn(id);
+    }
+
+    std::vector<int> to_vector() const {
+        std::vector<int> out;
+        out.reserve(size());
+        for_each([&out](int id) { out.push_back(id); });
+        return out;
+    }
+
+    std::uint64_t hash() const {
+        std::uint64_t h = 0x9e3779b97f4a7c15ULL;
+        auto          mix = [&h](std::uint64_t v) {
+            h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        };
+        for (auto w : bits_) mix(w);
+        for (int id : overflow_) mix(static_cast<std::uint32_t>(id));
+        return h;
+    }
+
+    bool operator==(const TagSet& o) const {
+        return bits_ == o.bits_ && overflow_ == o.overflow_;
+    }
+    bool operator!=(const TagSet& o) const { return !(*this == o); }
+
+    // 直接操作單一 bit（常駐索引維護每個任務的 mask 用）
+    static void set_bit(Mask& m, int id, bool on) {
+        if (!is_inline(id))
+            return;
+        const std::uint64_t bit = std::uint64_t(1) << (id & 63);
+        m[id >> 6]              = on ? (m[id >> 6] | bit) : (m[id >> 6] & ~bit);
+    }
+
+   private:
+    Mask             bits_{};
+    std::vector<int> overflow_; // 排序、不重複
+};
@@ -0,0 +1,13 @@
+#pragma once
+#include <crow_all.h>
+#include <string>
+
+// 503 + Retry-After：暫時性的資源不足（佇列滿、連線池借不到），客戶端可稍後重試
+inline crow::response busy_response(const std::string& error) {
+    crow::json::wvalue err;
+    err["error"] = error;
+    err["hint"]  = "Server is busy; retry shortly.";
+    crow::response res{503, err};
+    res.set_header("Retry-After", "1");
+    return res;
+}
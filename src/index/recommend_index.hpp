@@ -0,0 +1,291 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../domain/tag_set.hpp"
+#include "../repositories/task_repo.hpp"
+#include "../repositories/weight_repo.hpp"
+
+/// Resident copy of tasks + task_tag_weight used to serve /api/suggest from memory
+/// - Tasks are a dense struct-of-arrays; slot 0 is the newest task, so a lower
+///   slot wins ties the same way recommend_query's created_at DESC does
+/// - Each tag has a posting list of (slot, base_weight, alpha, beta), sorted by slot
+/// - Each task also has a TagSet::Mask of the tags whose posting counts towards
+///   tag_fit (alpha+beta != 0), so the matched-tag count is a popcount
+/// - reload() builds a fresh copy off-lock and swaps it in; readers go through
+///   read(fn), which holds a shared lock for the duration of fn
+/// - apply() mirrors alpha/beta deltas right after the DB write commits
+/// - refresh() pulls only rows whose updated_at is newer than the last watermark,
+///   with a full reload every fullReloadEvery (also picks up new/deleted tasks)
+class RecommendIndex : public WeightDeltaSink
+{
+   public:
+    struct Posting
+    {
+        int    slot; // Tasks 欄位下標；task_id = tasks.id[slot]
+        double base_weight;
+        double alpha;
+        double beta;
+    };
+
+    struct Tasks
+    {
+        std::vector<int>          id;
+        std::vector<int>          suggested_time;
+        std::vector<double>       score_quality;
+        std::vector<double>       score_popularity;
+        std::vector<std::string>  description;
+        std::vector<TagSet::Mask> tag_mask; // 有效 posting 的 tag（inline id）
+
+        std::size_t size() const { return id.size(); }
+    };
+
+    struct Data
+    {
+        Tasks                                         tasks;
+        std::unordered_map<int, std::vector<Posting>> postings; // tag_id -> list
+        std::unordered_map<int, int>                  slot_of;  // task_id -> slot
+
+        const std::vector<Posting>* postings_for(int tagId) const {
+            auto it = postings.find(tagId);
+            return it == postings.end() ? nullptr : &it->second;
+        }
+    };
+
+    /// What refresh() actually changed, so derived caches can drop just that
+    struct Changes
+    {
+        bool             all = false; // 全量重建，或任務欄位有變
+        std::vector<int> tags;        // posting 數值有變的 tag（可能重複）
+    };
+
+    explicit RecommendIndex(
+        std::chrono::seconds fullReloadEvery = std::chrono::hours(1))
+        : data_(std::make_unique<Data>()), fullReloadEvery_(fullReloadEvery) {}
+
+    RecommendIndex(const RecommendIndex&)            = delete;
+    RecommendIndex& operator=(const RecommendIndex&) = delete;
+
+    /// Full rebuild from PostgreSQL (startup and fallback of refresh)
+    void reload(pqxx::connection& c) {
+        std::lock_guard<std::mutex> rl(refreshMu_);
+        reload_locked(c);
+    }
+
+    /// Incremental reconciliation against rows changed since the last watermark.
+    /// Values from the DB are absolute, so re-reading the overlap window is
+    /// harmless and also repairs any delta that raced with a previous pass.
+    Changes refresh(pqxx::connection& c) {
+        std::lock_guard<std::mutex> rl(refreshMu_);
+        Changes                     changes;
+        if (watermark_.empty() ||
+            std::chrono::steady_clock::now() - lastFullReload_ >= fullReloadEvery_) {
+            reload_locked(c);
+            changes.all = true;
+            return changes;
+        }
+
+        const std::string next = db_now(c);
+        auto              taskRows =
+            TaskRepo(c).score_rows_updated_since(watermark_, kOverlapSec);
+        auto weightRows = WeightRepo(c).rows_updated_since(watermark_, kOverlapSec);
+
+        bool unknownTask = false;
+        {
+            std::unique_lock<std::shared_mutex> lk(mu_);
+            auto&                               d = *data_;
+            for (auto& row : taskRows) {
+                auto it = d.slot_of.find(row.id);
+                if (it == d.slot_of.end()) {
+                    unknownTask = true; // 新任務需要重排 slot，交給全量重建
+                    break;
+                }
+                const int slot = it->second;
+                auto&     t    = d.tasks;
+                changes.all |= t.suggested_time[slot] != row.suggested_time ||
+                               t.score_quality[slot] != row.score_quality ||
+                               t.score_popularity[slot] != row.score_popularity ||
+                               t.description[slot] != row.description;
+                t.suggested_time[slot]   = row.suggested_time;
+                t.score_quality[slot]    = row.score_quality;
+                t.score_popularity[slot] = row.score_popularity;
+                t.description[slot]      = std::move(row.description);
+            }
+            if (!unknownTask) {
+                for (auto const& w : weightRows) {
+                    bool  inserted = false;
+                    auto* p = find_or_insert(d, w.task_id, w.tag_id, &inserted);
+                    if (p) {
+                        // 重讀的重疊區間多半是寫入路徑已套用過的值，沒變就不回報
+                        if (inserted || p->base_weight != w.base_weight ||
+                            p->alpha != w.alpha || p->beta != w.beta)
+                            changes.tags.push_back(w.tag_id);
+                        p->base_weight = w.base_weight;
+                        p->alpha       = w.alpha;
+                        p->beta        = w.beta;
+                        sync_mask(d, *p, w.tag_id);
+                    }
+                }
+            }
+        }
+        if (unknownTask) {
+            reload_locked(c);
+            changes.all = true;
+            return changes;
+        }
+        watermark_ = next;
+        return changes;
+    }
+
+    /// WeightDeltaSink: same delta as the committed upsert (insert_* when the
+    /// (task, tag) row did not exist yet). Unknown tasks wait for refresh().
+    void apply(const std::vector<WeightDelta>& ds) override {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        auto&                               d = *data_;
+        for (auto const& delta : ds) {
+            bool  inserted = false;
+            auto* p = find_or_insert(d, delta.task_id, delta.tag_id, &inserted);
+            if (!p)
+                continue;
+            if (inserted) {
+                p->alpha = delta.insert_alpha;
+                p->beta  = delta.insert_beta;
+            }
+            else {
+                p->alpha += delta.d_alpha;
+                p->beta += delta.d_beta;
+            }
+            sync_mask(d, *p, delta.tag_id);
+        }
+    }
+
+    bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+    std::size_t task_count() const {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        return data_->tasks.size();
+    }
+
+    bool has_task(int taskId) const {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        return data_->slot_of.count(taskId) != 0;
+    }
+
+    /// Run fn(const Data&) under the shared lock; fn must not call back into the
+    /// index
+    template <typename Fn>
+    auto read(Fn&& fn) const {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        return fn(static_cast<const Data&>(*data_));
+    }
+
+   private:
+    // 對帳時回看的秒數：涵蓋在 watermark 之前開始、之後才 commit 的交易
+    static constexpr int kOverlapSec = 5;
+
+    mutable std::shared_mutex mu_;
+    std::unique_ptr<Data>     data_;
+    std::atomic<bool>         ready_{false};
+
+    // 只由 reload/refresh 使用（refreshMu_ 保護）
+    std::mutex                            refreshMu_;
+    std::string                           watermark_; // DB 端 LOCALTIMESTAMP
+    std::chrono::steady_clock::time_point lastFullReload_{};
+    std::chrono::seconds                  fullReloadEvery_;
+
+    void reload_locked(pqxx::connection& c) {
+        const std::string next       = db_now(c);
+        auto              taskRows   = TaskRepo(c).all_score_rows();
+        auto              weightRows = WeightRepo(c).all_rows();
+        auto              fresh      = build(taskRows, weightRows);
+        {
+            std::unique_lock<std::shared_mutex> lk(mu_);
+            data_.swap(fresh);
+        }
+        ready_.store(true, std::memory_order_release);
+        watermark_      = next;
+        lastFullReload_ = std::chrono::steady_clock::now();
+    }
+
+    static std::string db_now(pqxx::connection& c) {
+        pqxx::work tx(c);
+        auto       r = tx.exec("SELECT LOCALTIMESTAMP::text AS now");
+        tx.commit();
+        return r[0]["now"].as<std::string>();
+    }
+
+    // 找 (task, tag) 的 posting；不存在時依 slot 順序插入 base_weight=0.5
+    static Posting* find_or_insert(Data& d,
+                                   int   taskId,
+                                   int   tagId,
+                                   bool* inserted = nullptr) {
+        auto st = d.slot_of.find(taskId);
+        if (st == d.slot_of.end())
+            return nullptr;
+        const int slot = st->second;
+        auto&     list = d.postings[tagId];
+        auto      it   = std::lower_bound(
+            list.begin(), list.end(), slot, [](const Posting& p, int s) {
+                return p.slot < s;
+            });
+        if (it != list.end() && it->slot == slot)
+            return &*it;
+        if (inserted)
+            *inserted = true;
+        return &*list.insert(it, Posting{slot, 0.5, 1.0, 9.0});
+    }
+
+    // tag_fit 的 AVG 忽略 alpha+beta = 0 的 posting，mask 也一樣
+    static void sync_mask(Data& d, const Posting& p, int tagId) {
+        TagSet::set_bit(
+            d.tasks.tag_mask[p.slot], tagId, p.alpha + p.beta != 0.0);
+    }
+
+    static std::unique_ptr<Data> build(std::vector<TaskScoreRow>&       taskRows,
+                                       const std::vector<TagWeightRow>& weightRows) {
+        auto       d = std::make_unique<Data>();
+        const auto n = taskRows.size();
+        auto&      t = d->tasks;
+        t.id.reserve(n);
+        t.suggested_time.reserve(n);
+        t.score_quality.reserve(n);
+        t.score_popularity.reserve(n);
+        t.description.reserve(n);
+        t.tag_mask.assign(n, TagSet::Mask{});
+        d->slot_of.reserve(n);
+        for (auto& row : taskRows) {
+            d->slot_of.emplace(row.id, static_cast<int>(t.id.size()));
+            t.id.push_back(row.id);
+            t.suggested_time.push_back(row.suggested_time);
+            t.score_quality.push_back(row.score_quality);
+            t.score_popularity.push_back(row.score_popularity);
+            t.description.push_back(std::move(row.description));
+        }
+
+        for (auto const& w : weightRows) {
+            auto it = d->slot_of.find(w.task_id);
+            if (it == d->slot_of.end())
+                continue; // 兩次讀取之間新增的任務，下次刷新再補
+            const Posting p{it->second, w.base_weight, w.alpha, w.beta};
+            d->postings[w.tag_id].push_back(p);
+            sync_mask(*d, p, w.tag_id);
+        }
+        for (auto& kv : d->postings) {
+            auto& list = kv.second;
+            std::sort(list.begin(), list.end(), [](auto const& a, auto const& b) {
+                return a.slot < b.slot;
+            });
+            list.shrink_to_fit();
+        }
+        return d;
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include "../domain/ranking_profile.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define TP_SCORE_X86 1
+#include <immintrin.h>
+#endif
+
+/// Batch final_score over the resident index's struct-of-arrays columns
+/// - time_fit = exp(-|ln x|) with x = (user+eps)/(sug+eps) is evaluated as
+///   min(x, 1/x) = min(u, s) / max(u, s), which is the same function with one
+///   division and no log/exp; it differs from the std::exp/std::log form only
+///   by rounding (relative error < 1e-15)
+/// - the AVX2 path is compiled with a target attribute and picked at runtime
+///   (__builtin_cpu_supports), so the binary still runs on CPUs without AVX2;
+///   other architectures always use the scalar loop
+/// - both paths do the same IEEE operations in the same order (no FMA), so the
+///   ranking is identical whichever one runs
+/// - each path is instantiated twice: with DefaultRanking, whose weights are
+///   constexpr and fold into the loop, and with runtime RankingWeights;
+///   score() picks the instantiation by argument type
+namespace scoring {
+
+    // 每個任務一列；n 個元素的欄位
+    struct Columns
+    {
+        const double* tag_fit;
+        const int*    suggested_time;
+        const double* score_quality;
+        const double* score_popularity;
+    };
+
+    constexpr double kEps        = 1e-6;
+    constexpr double kTimeFitDef = 0.8; // 使用者或任務沒有時間
+
+    inline double time_fit(int userMin, int sugMin) {
+        if (userMin <= 0 || sugMin <= 0)
+            return kTimeFitDef;
+        const double u = userMin + kEps;
+        const double s = sugMin + kEps;
+        return std::min(u, s) / std::max(u, s);
+    }
+
+    template <typename W>
+    inline void score_scalar(const Columns& c,
+                             const W&       w,
+                             int            userMin,
+                             int            n,
+                             double*        out) {
+        for (int i = 0; i < n; ++i) {
+            out[i] = w.tag * c.tag_fit[i] +
+                     w.time * time_fit(userMin, c.suggested_time[i]) +
+                     w.quality * c.score_quality[i] +
+                     w.popularity * c.score_popularity[i];
+        }
+    }
+
+#if defined(TP_SCORE_X86)
+    template <typename W>
+    __attribute__((target("avx2"))) inline void score_avx2(const Columns& c,
+                                                           const W&       w,
+                                                           int     userMin,
+                                                           int     n,
+                                                           double* out) {
+        const __m256d wTag  = _mm256_set1_pd(w.tag);
+        const __m256d wTime = _mm256_set1_pd(w.time);
+        const __m256d wQ    = _mm256_set1_pd(w.quality);
+        const __m256d wP    = _mm256_set1_pd(w.popularity);
+        const __m256d eps   = _mm256_set1_pd(kEps);
+        const __m256d def   = _mm256_set1_pd(kTimeFitDef);
+        const __m256d zero  = _mm256_setzero_pd();
+        const __m256d u     = _mm256_set1_pd(userMin + kEps);
+
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d tf;
+            if (userMin <= 0) {
+                tf = def;
+            }
+            else {
+                const __m128i sugI = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(c.suggested_time + i));
+                const __m256d sug = _mm256_cvtepi32_pd(sugI);
+                const __m256d s   = _mm256_add_pd(sug, eps);
+                tf = _mm256_div_pd(_mm256_min_pd(u, s), _mm256_max_pd(u, s));
+                // sug <= 0 → 0.8
+                tf = _mm256_blendv_pd(tf, def, _mm256_cmp_pd(sug, zero, _CMP_LE_OQ));
+            }
+            __m256d acc =
+                _mm256_mul_pd(wTag, _mm256_loadu_pd(c.tag_fit + i));
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(wTime, tf));
+            acc = _mm256_add_pd(
+                acc, _mm256_mul_pd(wQ, _mm256_loadu_pd(c.score_quality + i)));
+            acc = _mm256_add_pd(
+                acc, _mm256_mul_pd(wP, _mm256_loadu_pd(c.score_popularity + i)));
+            _mm256_storeu_pd(out + i, acc);
+        }
+        if (i < n) {
+            const Columns tail{c.tag_fit + i,
+                               c.suggested_time + i,
+                               c.score_quality + i,
+                               c.score_popularity + i};
+            score_scalar(tail, w, userMin, n - i, out + i);
+        }
+    }
+#endif
+
+    using FixedFn = void (*)(const Columns&, int, int, double*);
+    using ScoreFn =
+        void (*)(const Columns&, const RankingWeights&, int, int, double*);
+
+    struct Kernel
+    {
+        FixedFn     fixed;   // DefaultRanking
+        ScoreFn     dynamic; // 執行期的 profile
+        const char* name;
+    };
+
+    inline void score_scalar_fixed(const Columns& c, int u, int n, double* out) {
+        score_scalar(c, DefaultRanking{}, u, n, out);
+    }
+
+#if defined(TP_SCORE_X86)
+    __attribute__((target("avx2"))) inline void
+    score_avx2_fixed(const Columns& c, int u, int n, double* out) {
+        score_avx2(c, DefaultRanking{}, u, n, out);
+    }
+#endif
+
+    inline Kernel resolve() {
+#if defined(TP_SCORE_X86)
+        if (__builtin_cpu_supports("avx2"))
+            return {score_avx2_fixed, score_avx2<RankingWeights>, "avx2"};
+#endif
+        return {score_scalar_fixed, score_scalar<RankingWeights>, "scalar"};
+    }
+
+    // 第一次呼叫時偵測 CPU，之後固定
+    inline const Kernel& kernel() {
+        static const Kernel k = resolve();
+        return k;
+    }
+
+    /// out[i] = final_score of row i (n rows), default weights
+    inline void score(const Columns& c,
+                      DefaultRanking,
+                      int     userMin,
+                      int     n,
+                      double* out) {
+        kernel().fixed(c, userMin, n, out);
+    }
+
+    /// Same with a runtime profile
+    inline void score(const Columns&        c,
+                      const RankingWeights& w,
+                      int                   userMin,
+                      int                   n,
+                      double*               out) {
+        kernel().dynamic(c, w, userMin, n, out);
+    }
+
+} // namespace scoring
@@ -0,0 +1,338 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../repositories/task_repo.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/// pg_trgm-compatible trigram extraction (same rules as show_trgm/similarity)
+/// - text is split into words of alphanumeric characters (CJK counts as letters,
+///   so a run of Chinese without spaces is one word); everything else separates
+/// - each lower-cased word is padded as "  word " and cut into 3-codepoint grams
+/// - the result is a sorted, de-duplicated set; similarity = |A∩B| / |A∪B|
+namespace trgm {
+
+    using Gram = std::uint64_t; // 三個 codepoint，各 21 bits
+
+    // 解一個 UTF-8 字元；不合法的位元組當作分隔字元
+    inline char32_t next_cp(const std::string& s, std::size_t& i) {
+        const auto  c0  = static_cast<unsigned char>(s[i]);
+        std::size_t len = 0;
+        if (c0 < 0x80)
+            len = 1;
+        else if ((c0 >> 5) == 0x6)
+            len = 2;
+        else if ((c0 >> 4) == 0xE)
+            len = 3;
+        else if ((c0 >> 3) == 0x1E)
+            len = 4;
+        if (len == 0 || i + len > s.size()) {
+            ++i;
+            return U' ';
+        }
+        char32_t cp = len == 1 ? c0 : c0 & (0x7F >> len);
+        for (std::size_t k = 1; k < len; ++k) {
+            const auto ck = static_cast<unsigned char>(s[i + k]);
+            if ((ck & 0xC0) != 0x80) {
+                ++i;
+                return U' ';
+            }
+            cp = (cp << 6) | (ck & 0x3F);
+        }
+        i += len;
+        return cp;
+    }
+
+    // 對應 UTF-8 locale 的 iswalnum：標點、符號、emoji 是分隔字元，其餘文字都算
+    inline bool is_word(char32_t c) {
+        if (c < 0x80)
+            return (c >= '0' && c <= '9') ||
+                   ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+        if (c < 0xC0)
+            return c == 0xAA || c == 0xB5 || c == 0xBA;
+        if (c == 0xD7 || c == 0xF7)
+            return false;
+        if ((c >= 0x2000 && c <= 0x2BFF) || (c >= 0x2E00 && c <= 0x2E7F))
+            return false; // 一般標點、貨幣、箭頭、數學、框線等
+        if (c >= 0x3000 && c <= 0x303F)
+            return c >= 0x3005 && c <= 0x3007; // 々〆〇；其餘是全形標點
+        if (c >= 0xFE10 && c <= 0xFE6F)
+            return false; // 直排與小型標點
+        if (c >= 0xFF00 && c <= 0xFFEF)
+            return (c >= 0xFF10 && c <= 0xFF19) || (c >= 0xFF21 && c <= 0xFF3A) ||
+                   (c >= 0xFF41 && c <= 0xFF5A) || (c >= 0xFF66 && c <= 0xFFDC);
+        if (c >= 0xFFF0 && c <= 0xFFFF)
+            return false;
+        if (c >= 0x1F000 && c <= 0x1FAFF)
+            return false; // emoji
+        return true;
+    }
+
+    // 與 LOWER() 一致的常見範圍（中日文沒有大小寫）
+    inline char32_t to_lower(char32_t c) {
+        if (c >= 'A' && c <= 'Z')
+            return c + 0x20;
+        if (c < 0xC0)
+            return c;
+        if ((c <= 0xDE && c != 0xD7) || (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) ||
+            (c >= 0x410 && c <= 0x42F) || (c >= 0xFF21 && c <= 0xFF3A))
+            return c + 0x20;
+        if (c >= 0x400 && c <= 0x40F)
+            return c + 0x50;
+        if (c >= 0x100 && c <= 0x17E && c != 0x130 && c != 0x138 && c != 0x149 &&
+            c != 0x178) {
+            // Latin Extended-A：大寫與小寫相鄰，大寫在偶數或奇數位置依區段而定
+            const bool upperOdd = (c >= 0x139 && c <= 0x148) || c >= 0x179;
+            if (((c & 1) != 0) == upperOdd)
+                return c + 1;
+        }
+        return c;
+    }
+
+    inline Gram pack(char32_t a, char32_t b, char32_t c) {
+        return (Gram(a) << 42) | (Gram(b) << 21) | Gram(c);
+    }
+
+    inline std::vector<Gram> extract(const std::string& text) {
+        std::vector<Gram>     out;
+        std::vector<char32_t> word;
+        auto                  emit = [&] {
+            if (word.empty())
+                return;
+            char32_t a = U' ', b = U' ';
+            word.push_back(U' ');
+            for (char32_t c : word) {
+                out.push_back(pack(a, b, c));
+                a = b;
+                b = c;
+            }
+            word.clear();
+        };
+        for (std::size_t i = 0; i < text.size();) {
+            const char32_t c = next_cp(text, i);
+            if (is_word(c))
+                word.push_back(to_lower(c));
+            else
+                emit();
+        }
+        emit();
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return out;
+    }
+
+    // 與 pg_trgm 相同以 float4 計算，門檻比較結果才會一致
+    inline double similarity(std::size_t common, std::size_t na, std::size_t nb) {
+        if (na == 0 || nb == 0)
+            return 0.0;
+        return static_cast<float>(common) / static_cast<float>(na + nb - common);
+    }
+
+} // namespace trgm
+
+/// Resident trigram inverted index over tasks.description for near-duplicate
+/// detection, answering the same question as the suggest_similar statement
+/// - every distinct trigram gets a dense id; a task is its sorted id array and
+///   each id has a posting list of task slots (ascending)
+/// - find_similar() applies the count filter: with n query trigrams a match
+///   needs more than threshold * n shared ones, so only the n - minOverlap + 1
+///   rarest posting lists are scanned for candidates (prefix filter), and
+///   candidates whose size rules them out are dropped (length filter)
+/// - the survivors are verified by intersecting sorted id arrays (SSE2 when
+///   available) and scored with pg_trgm's formula
+/// - reload() rebuilds off-lock from PostgreSQL and swaps; it is the only way
+///   in, since nothing in this service inserts tasks, and it also drops deleted
+///   tasks
+class TrigramIndex
+{
+   public:
+    struct Data
+    {
+        std::vector<int>                              id;       // slot -> task_id
+        std::vector<std::vector<std::uint32_t>>       grams;    // slot -> gram id
+        std::unordered_map<trgm::Gram, std::uint32_t> dict;     // gram -> id
+        std::vector<std::vector<std::uint32_t>>       postings; // id -> slots
+    };
+
+    TrigramIndex() : data_(std::make_unique<Data>()) {}
+
+    TrigramIndex(const TrigramIndex&)            = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    /// Full rebuild from PostgreSQL (startup and periodic reconciliation)
+    void reload(pqxx::connection& c) {
+        std::lock_guard<std::mutex> rl(reloadMu_);
+        auto                        rows  = TaskRepo(c).all_rows();
+        auto                        fresh = std::make_unique<Data>();
+        fresh->id.reserve(rows.size());
+        fresh->grams.reserve(rows.size());
+        for (auto const& row : rows) add(*fresh, row.id, row.description);
+        for (auto& list : fresh->postings) list.shrink_to_fit();
+
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        data_.swap(fresh);
+    }
+
+    /// Tasks with similarity(LOWER(description), LOWER(desc)) > threshold,
+    /// best first (ties by task id)
+    std::vector<TaskCandidate> find_similar(const std::string& desc,
+                                            double             threshold,
+                                            int                limit = 3) const {
+        const auto q = trgm::extract(desc);
+        const auto n = q.size();
+        if (n == 0 || limit <= 0)
+            return {};
+        // sim <= common / n，所以至少要共有 minOverlap 個 gram
+        const std::size_t minOverlap = threshold < 0.0 ? 1
+                                       : static_cast<std::size_t>(
+                                             std::floor(threshold * double(n))) +
+                                             1;
+        if (minOverlap > n)
+            return {};
+
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        const Data&                         d = *data_;
+
+        // 查詢中沒出現在任何任務的 gram 也算在 n 裡，但不可能命中
+        std::vector<std::uint32_t> known;
+        known.reserve(n);
+        for (auto g : q) {
+            auto it = d.dict.find(g);
+            if (it != d.dict.end())
+                known.push_back(it->second);
+        }
+        if (known.size() < minOverlap)
+            return {};
+
+        // prefix filter：共有 minOverlap 個以上，必定命中任意 n - minOverlap + 1 個
+        // 之中的一個；unknown 的 gram 佔掉其中幾個名額（posting 為空），
+        // 剩下的從最短的 list 開始掃
+        const std::size_t prefix = known.size() - minOverlap + 1;
+        std::sort(known.begin(), known.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return d.postings[a].size() < d.postings[b].size();
+        });
+        std::vector<std::uint32_t> cands;
+        for (std::size_t k = 0; k < prefix; ++k) {
+            auto const& list = d.postings[known[k]];
+            cands.insert(cands.end(), list.begin(), list.end());
+        }
+        std::sort(cands.begin(), cands.end());
+        cands.erase(std::unique(cands.begin(), cands.end()), cands.end());
+
+        // length filter：min(n, m) / max(n, m) 是相似度上限
+        std::sort(known.begin(), known.end());
+        const double               lo = threshold * double(n);
+        const double hi = threshold > 0.0 ? double(n) / threshold : 1e18;
+        std::vector<TaskCandidate> out;
+        for (auto slot : cands) {
+            auto const&       g = d.grams[slot];
+            const std::size_t m = g.size();
+            if (double(m) <= lo || double(m) >= hi)
+                continue;
+            const std::size_t common =
+                intersect_count(known.data(), known.size(), g.data(), m);
+            if (common < minOverlap)
+                continue;
+            const double sim = trgm::similarity(common, n, m);
+            if (sim > threshold)
+                out.push_back({d.id[slot], sim});
+        }
+        lk.unlock();
+
+        auto better = [](const TaskCandidate& a, const TaskCandidate& b) {
+            return a.similarity != b.similarity ? a.similarity > b.similarity
+                                                : a.id < b.id;
+        };
+        const auto k = std::min(out.size(), static_cast<std::size_t>(limit));
+        std::partial_sort(out.begin(), out.begin() + k, out.end(), better);
+        out.resize(k);
+        return out;
+    }
+
+    std::size_t task_count() const {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        return data_->id.size();
+    }
+
+    std::size_t gram_count() const {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        return data_->postings.size();
+    }
+
+    /// |a ∩ b| for sorted arrays of distinct ids
+    static std::size_t intersect_count(const std::uint32_t* a,
+                                       std::size_t          na,
+                                       const std::uint32_t* b,
+                                       std::size_t          nb) {
+        std::size_t i = 0, j = 0, common = 0;
+#if defined(__SSE2__)
+        // 4x4 區塊比對：a 的一組與 b 的一組四種旋轉各比一次，較小者前進
+        while (i + 4 <= na && j + 4 <= nb) {
+            const __m128i va =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            const __m128i vb =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+            const __m128i r1 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+            const __m128i r2 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+            const __m128i r3 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3));
+            __m128i       eq = _mm_cmpeq_epi32(va, vb);
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, r1));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, r2));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, r3));
+            common += static_cast<std::size_t>(
+                __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(eq))));
+            const std::uint32_t amax = a[i + 3], bmax = b[j + 3];
+            i += amax <= bmax ? 4 : 0;
+            j += bmax <= amax ? 4 : 0;
+        }
+#endif
+        while (i < na && j < nb) {
+            if (a[i] < b[j])
+                ++i;
+            else if (b[j] < a[i])
+                ++j;
+            else {
+                ++common;
+                ++i;
+                ++j;
+            }
+        }
+        return common;
+    }
+
+   private:
+    mutable std::shared_mutex mu_;
+    std::unique_ptr<Data>     data_;
+    std::mutex                reloadMu_;
+
+    // 任務依序接在最後一個 slot，posting list 自然遞增
+    static void add(Data& d, int taskId, const std::string& description) {
+        const auto slot = static_cast<std::uint32_t>(d.id.size());
+
+        std::vector<std::uint32_t> ids;
+        for (auto g : trgm::extract(description)) {
+            auto [it, fresh] =
+                d.dict.try_emplace(g, static_cast<std::uint32_t>(d.postings.size()));
+            if (fresh)
+                d.postings.emplace_back();
+            ids.push_back(it->second);
+        }
+        std::sort(ids.begin(), ids.end());
+        for (auto gid : ids) d.postings[gid].push_back(slot);
+
+        d.id.push_back(taskId);
+        d.grams.push_back(std::move(ids));
+    }
+};
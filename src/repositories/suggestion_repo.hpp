@@ -2,6 +2,9 @@
 #include <pqxx/pqxx>
 #include <vector>
 #include <string>
+#include "../db/pipeline.hpp"
+#include "../db/statement_timings.hpp"
+#include "../db/unit_of_work.hpp"
 
 class SuggestionRepo
 {
@@ -12,11 +15,9 @@ class SuggestionRepo
                int                suggested_time,
                const std::string& status = "pending",
                int                votes  = 1) {
-        pqxx::work tx(c_);
-        auto       r = tx.exec_prepared(
-            "sugg_insert", description, suggested_time, status, votes);
-        int id = r[0]["id"].as<int>();
-        tx.commit();
+        UnitOfWork uow(c_);
+        int        id = insert(uow, description, suggested_time, status, votes);
+        uow.commit();
         return id;
     }
 
@@ -25,20 +26,86 @@ class SuggestionRepo
                      double                  baseWeight = 0.6,
                      double                  alpha      = 1.0,
                      double                  beta       = 9.0) {
-        pqxx::work tx(c_);
+        UnitOfWork uow(c_);
+        insert_tags(uow, suggestionId, tagIds, baseWeight, alpha, beta);
+        uow.commit();
+    }
+
+    void upsert_alias(int suggestionId, int taskId, double similarity) {
+        UnitOfWork uow(c_);
+        upsert_alias(uow, suggestionId, taskId, similarity);
+        uow.commit();
+    }
+
+    // ---- UnitOfWork 版本：在呼叫端的交易內執行，由呼叫端 commit ----
+
+    int insert(UnitOfWork&        uow,
+               const std::string& description,
+               int                suggested_time,
+               const std::string& status = "pending",
+               int                votes  = 1) {
+        auto r = exec_prepared_timed(
+            uow.tx(), "sugg_insert", description, suggested_time, status, votes);
+        return inserted_id(r);
+    }
+
+    void insert_tags(UnitOfWork&             uow,
+                     int                     suggestionId,
+                     const std::vector<int>& tagIds,
+                     double                  baseWeight = 0.6,
+                     double                  alpha      = 1.0,
+                     double                  beta       = 9.0) {
+        for (int tagId : tagIds) {
+            exec_prepared_timed(uow.tx(),
+                                "sugg_tag_insert",
+                                suggestionId,
+                                tagId,
+                                baseWeight,
+                                alpha,
+                                beta);
+        }
+    }
+
+    void upsert_alias(UnitOfWork& uow, int suggestionId, int taskId, double sim) {
+        exec_prepared_timed(uow.tx(), "alias_upsert", suggestionId, taskId, sim);
+    }
+
+    // ---- Pipeline 版本：只排入批次，p.flush() 時與其他語句一起送出 ----
+    // 同一批次內後續語句以 last_inserted_id() 引用剛插入的 id
+
+    Pipeline::Ticket insert(Pipeline&          p,
+                            const std::string& description,
+                            int                suggested_time,
+                            const std::string& status = "pending",
+                            int                votes  = 1) {
+        return p.prepared("sugg_insert", description, suggested_time, status, votes);
+    }
+
+    template <typename Id>
+    void insert_tags(Pipeline&               p,
+                     const Id&               suggestionId,
+                     const std::vector<int>& tagIds,
+                     double                  baseWeight = 0.6,
+                     double                  alpha      = 1.0,
+                     double                  beta       = 9.0) {
         for (int tagId : tagIds) {
-            tx.exec_prepared(
+            p.prepared(
                 "sugg_tag_insert", suggestionId, tagId, baseWeight, alpha, beta);
         }
-        tx.commit();
     }
 
-    void upsert_alias(int suggestionId, int taskId, double similarity) {
-        pqxx::work tx(c_);
-        tx.exec_prepared("alias_upsert", suggestionId, taskId, similarity);
-        tx.commit();
+    template <typename Id>
+    void upsert_alias(Pipeline& p, const Id& suggestionId, int taskId, double sim) {
+        p.prepared("alias_upsert", suggestionId, taskId, sim);
+    }
+
+    // 本 session 最近一次 sugg_insert 取得的 id（同一批次內有效）
+    static SqlExpr last_inserted_id() {
+        return {"currval(pg_get_serial_sequence('task_suggestion_buffer', 'id'))"};
     }
 
+    static int inserted_id(const pqxx::result& r) { return r[0]["id"].as<int>(); }
+
    private:
     pqxx::connection& c_;
 };
@@ -54,6 +54,24 @@ class TagRepo
         return out;
     }
 
+    // 整張 tag_dim（含停用的 tag；給 TagDictionary）
+    std::vector<TagRow> list_all() {
+        pqxx::work tx(c_);
+        auto       r = tx.exec(R"(SELECT id, code, label, group_code, is_active
+                        FROM tag_dim ORDER BY id)");
+        tx.commit();
+        std::vector<TagRow> out;
+        out.reserve(r.size());
+        for (auto const& row : r) {
+            out.push_back({row["id"].as<int>(),
+                           row["code"].as<std::string>(),
+                           row["label"].as<std::string>(),
+                           row["group_code"].as<std::string>(),
+                           row["is_active"].as<bool>()});
+        }
+        return out;
+    }
+
    private:
     pqxx::connection& c_;
 
@@ -3,6 +3,11 @@
 #include <vector>
 #include <string>
 #include <optional>
+#include "../db/pg_array.hpp"
+#include "../db/statement_timings.hpp"
+#include "../domain/ranking_profile.hpp"
+#include "../domain/tag_set.hpp"
+#include "../db/unit_of_work.hpp"
 
 struct TaskCandidate
 {
@@ -17,6 +22,16 @@ struct TaskRow
     int         suggested_time;
 };
 
+// 常駐推薦索引載入用（tasks + task_stats）
+struct TaskScoreRow
+{
+    int         id;
+    std::string description;
+    int         suggested_time;
+    double      score_quality;
+    double      score_popularity;
+};
+
 class TaskRepo
 {
    public:
@@ -25,9 +40,19 @@ class TaskRepo
     std::vector<TaskCandidate> find_similar(const std::string& desc,
                                             double             threshold,
                                             int                limit = 3) {
-        pqxx::work tx(c_);
-        auto       r = tx.exec_prepared("suggest_similar", desc, threshold, limit);
-        tx.commit();
+        UnitOfWork uow(c_);
+        auto       out = find_similar(uow, desc, threshold, limit);
+        uow.commit();
+        return out;
+    }
+
+    // 在呼叫端的交易內查詢（與後續寫入同一個交易）
+    std::vector<TaskCandidate> find_similar(UnitOfWork&        uow,
+                                            const std::string& desc,
+                                            double             threshold,
+                                            int                limit = 3) {
+        auto r = exec_prepared_timed(
+            uow.tx(), "suggest_similar", desc, threshold, limit);
         std::vector<TaskCandidate> out;
         out.reserve(r.size());
         for (auto const& row : r) {
@@ -61,25 +86,105 @@ class TaskRepo
         return r[0]["id"].as<int>();
     }
 
-    // 取得基礎推薦查詢結果（給 service 做 time_fit 與最後排序）
-    pqxx::result recommend_rows(const std::vector<int>& tagIds, int limit) {
-        pqxx::work  tx(c_);
-        std::string arr = to_pg_array(tagIds);
-        auto        r   = tx.exec_prepared("recommend_query", arr, limit);
+    // 取得已排序的 Top-K 推薦結果（final_score 在 DB 端算完才 LIMIT）
+    // w 為空時用權重寫死的 recommend_query，否則 recommend_query_weighted
+    pqxx::result recommend_rows(const TagSet&         tags,
+                                int                   timeMinutes,
+                                int                   limit,
+                                const RankingWeights* w = nullptr) {
+        pqxx::work   tx(c_);
+        std::string  arr = to_pg_int_array(tags);
+        pqxx::result r;
+        if (!w)
+            r = exec_prepared_timed(
+                tx, "recommend_query", arr, limit, timeMinutes);
+        else
+            r = exec_prepared_timed(tx,
+                                    "recommend_query_weighted",
+                                    arr,
+                                    limit,
+                                    timeMinutes,
+                                    w->tag,
+                                    w->time,
+                                    w->quality,
+                                    w->popularity,
+                                    w->base,
+                                    w->mean);
         tx.commit();
         return r;
     }
 
+    // 全部任務的描述（給常駐相似度索引）
+    std::vector<TaskRow> all_rows() {
+        pqxx::work tx(c_);
+        auto       r = tx.exec(
+            "SELECT id, description, suggested_time FROM tasks ORDER BY id");
+        tx.commit();
+        std::vector<TaskRow> out;
+        out.reserve(r.size());
+        for (auto const& row : r) {
+            out.push_back({row["id"].as<int>(),
+                           row["description"].as<std::string>(),
+                           row["suggested_time"].as<int>()});
+        }
+        return out;
+    }
+
+    // 全部任務 id（升冪），給事件聚合視窗驗證 task_id
+    std::vector<int> all_ids() {
+        pqxx::work tx(c_);
+        auto       r = tx.exec("SELECT id FROM tasks ORDER BY id");
+        tx.commit();
+        std::vector<int> out;
+        out.reserve(r.size());
+        for (auto const& row : r) out.push_back(row[0].as<int>());
+        return out;
+    }
+
+    // 全部任務（新→舊；同分時與 recommend_query 一樣新者優先），給常駐索引
+    std::vector<TaskScoreRow> all_score_rows() {
+        pqxx::work tx(c_);
+        auto       r = tx.exec(R"(SELECT t.id, t.description, t.suggested_time,
+                               COALESCE(ts.score_quality, 0.0)    AS score_quality,
+                               COALESCE(ts.score_popularity, 0.0) AS score_popularity
+                        FROM   tasks t
+                        LEFT   JOIN task_stats ts ON ts.task_id = t.id
+                        ORDER  BY t.created_at DESC, t.id DESC)");
+        tx.commit();
+        return to_score_rows(r);
+    }
+
+    // 增量對帳：任務本身或其 task_stats 在 since 之後有異動者
+    std::vector<TaskScoreRow> score_rows_updated_since(const std::string& since,
+                                                       int overlapSec) {
+        pqxx::work tx(c_);
+        auto       r = tx.exec_params(
+            R"(SELECT t.id, t.description, t.suggested_time,
+                      COALESCE(ts.score_quality, 0.0)    AS score_quality,
+                      COALESCE(ts.score_popularity, 0.0) AS score_popularity
+               FROM   tasks t
+               LEFT   JOIN task_stats ts ON ts.task_id = t.id
+               WHERE  t.updated_at  > $1::timestamp - make_interval(secs => $2)
+                  OR  ts.updated_at > $1::timestamp - make_interval(secs => $2))",
+            since,
+            overlapSec);
+        tx.commit();
+        return to_score_rows(r);
+    }
+
    private:
-    pqxx::connection&  c_;
-    static std::string to_pg_array(const std::vector<int>& v) {
-        std::string s = "{";
-        for (size_t i = 0; i < v.size(); ++i) {
-            if (i)
-                s += ',';
-            s += std::to_string(v[i]);
+    pqxx::connection& c_;
+
+    static std::vector<TaskScoreRow> to_score_rows(const pqxx::result& r) {
+        std::vector<TaskScoreRow> out;
+        out.reserve(r.size());
+        for (auto const& row : r) {
+            out.push_back({row["id"].as<int>(),
+                           row["description"].as<std::string>(),
+                           row["suggested_time"].as<int>(),
+                           row["score_quality"].as<double>(),
+                           row["score_popularity"].as<double>()});
         }
-        s += "}";
-        return s;
+        return out;
     }
 };
@@ -1,22 +1,138 @@
 #pragma once
 #include <pqxx/pqxx>
+#include <algorithm>
+#include <string>
 #include <vector>
 #include <utility>
+#include "../db/pg_array.hpp"
+#include "../db/pipeline.hpp"
+#include "../db/statement_timings.hpp"
+#include "../util/log.hpp"
+
+struct TagWeightRow
+{
+    int    task_id;
+    int    tag_id;
+    double base_weight;
+    double alpha;
+    double beta;
+};
+
+// 單一 (task, tag) 的 alpha/beta 增量；列不存在時以 insert_* 建立
+// （對應 upsert 的 VALUES，預設 alpha=1.0, beta=9.0）
+struct WeightDelta
+{
+    int    task_id;
+    int    tag_id;
+    double d_alpha;
+    double d_beta;
+    double insert_alpha = 1.0;
+    double insert_beta  = 9.0;
+};
+
+// DB 寫入成功後接收同一份增量（例如常駐推薦索引）
+class WeightDeltaSink
+{
+   public:
+    virtual ~WeightDeltaSink()                              = default;
+    virtual void apply(const std::vector<WeightDelta>& ds) = 0;
+};
+
+// 同一份增量轉給多個 sink（例如常駐推薦索引 + 推薦結果快取）
+class WeightDeltaFanout : public WeightDeltaSink
+{
+   public:
+    void add(WeightDeltaSink* sink) {
+        if (sink)
+            sinks_.push_back(sink);
+    }
+    bool empty() const { return sinks_.empty(); }
+
+    void apply(const std::vector<WeightDelta>& ds) override {
+        for (auto* s : sinks_) s->apply(ds);
+    }
+
+   private:
+    std::vector<WeightDeltaSink*> sinks_;
+};
 
 class WeightRepo
 {
    public:
-    explicit WeightRepo(pqxx::connection& c) : c_(c) {}
+    explicit WeightRepo(pqxx::connection& c, WeightDeltaSink* sink = nullptr)
+        : c_(c), sink_(sink) {}
 
-    // 採用事件：alpha += 1（snake_case）
+    // 採用事件：alpha += 1（snake_case）；整批一次 upsert
     void reinforce(int taskId, const std::vector<int>& tagIds) {
-        pqxx::work tx(c_);
-        for (int tagId : tagIds) {
-            tx.exec_prepared("tasktag_upsert_adopt", taskId, tagId);
+        UnitOfWork uow(c_);
+        reinforce(uow, taskId, tagIds);
+        uow.commit();
+        TP_LOG_SAMPLED(LogLevel::Debug,
+                       20,
+                       "reinforce committed",
+                       log_kv("taskId", taskId),
+                       log_kv("count", tagIds.size()));
+    }
+
+    // 略過/曝光事件：beta += 1；整批一次 upsert
+    void penalize(int taskId, const std::vector<int>& tagIds) {
+        UnitOfWork uow(c_);
+        penalize(uow, taskId, tagIds);
+        uow.commit();
+    }
+
+    // UnitOfWork 版本：在呼叫端的交易內寫入，commit 之後才套用增量
+    void reinforce(UnitOfWork& uow, int taskId, const std::vector<int>& tagIds) {
+        upsert(uow, "tasktag_upsert_adopt", taskId, tagIds, 1.0, 0.0);
+    }
+
+    void penalize(UnitOfWork& uow, int taskId, const std::vector<int>& tagIds) {
+        upsert(uow, "tasktag_upsert_skip", taskId, tagIds, 0.0, 1.0);
+    }
+
+    // Pipeline 版本：排入批次，批次確定寫入後才套用增量
+    void reinforce(Pipeline& p, int taskId, const std::vector<int>& tagIds) {
+        auto tags = distinct(tagIds);
+        if (tags.empty())
+            return;
+        p.prepared("tasktag_upsert_adopt", taskId, to_pg_int_array(tags));
+        p.after_commit([sink = sink_, taskId, tags] {
+            publish(sink, taskId, tags, /*dAlpha*/ 1.0, /*dBeta*/ 0.0);
+        });
+    }
+
+    // 整批套用已合併的增量（每個 (task, tag) 一列），一個交易、一次 round trip
+    void apply_deltas(const std::vector<WeightDelta>& ds) {
+        if (ds.empty())
+            return;
+        std::vector<int>    taskIds, tagIds;
+        std::vector<double> dAlpha, dBeta, insAlpha, insBeta;
+        taskIds.reserve(ds.size());
+        tagIds.reserve(ds.size());
+        dAlpha.reserve(ds.size());
+        dBeta.reserve(ds.size());
+        insAlpha.reserve(ds.size());
+        insBeta.reserve(ds.size());
+        for (auto const& d : ds) {
+            taskIds.push_back(d.task_id);
+            tagIds.push_back(d.tag_id);
+            dAlpha.push_back(d.d_alpha);
+            dBeta.push_back(d.d_beta);
+            insAlpha.push_back(d.insert_alpha);
+            insBeta.push_back(d.insert_beta);
         }
+        pqxx::work tx(c_);
+        exec_prepared_timed(tx,
+                            "tasktag_apply_deltas",
+                            to_pg_int_array(taskIds),
+                            to_pg_int_array(tagIds),
+                            to_pg_float_array(dAlpha),
+                            to_pg_float_array(dBeta),
+                            to_pg_float_array(insAlpha),
+                            to_pg_float_array(insBeta));
         tx.commit();
-        std::cout << "[DEBUG] reinforce committed taskId=" << taskId
-                  << " count=" << tagIds.size() << std::endl;
+        if (sink_)
+            sink_->apply(ds);
     }
 
     // 設定 base_weight（snake_case）
@@ -38,6 +154,83 @@ class WeightRepo
         tx.commit();
     }
 
+    // 全表讀取（給常駐推薦索引重建）
+    std::vector<TagWeightRow> all_rows() {
+        pqxx::work tx(c_);
+        auto       r = tx.exec(
+            "SELECT task_id, tag_id, base_weight, alpha, beta FROM task_tag_weight");
+        tx.commit();
+        std::vector<TagWeightRow> out;
+        out.reserve(r.size());
+        for (auto const& row : r) {
+            out.push_back({row["task_id"].as<int>(),
+                           row["tag_id"].as<int>(),
+                           row["base_weight"].as<double>(),
+                           row["alpha"].as<double>(),
+                           row["beta"].as<double>()});
+        }
+        return out;
+    }
+
+    // 增量對帳：updated_at 晚於 since 的列（since 為 DB 端 timestamp 字串）
+    std::vector<TagWeightRow> rows_updated_since(const std::string& since,
+                                                 int overlapSec) {
+        pqxx::work tx(c_);
+        auto       r = tx.exec_params(
+            R"(SELECT task_id, tag_id, base_weight, alpha, beta
+               FROM   task_tag_weight
+               WHERE  updated_at > $1::timestamp - make_interval(secs => $2))",
+            since,
+            overlapSec);
+        tx.commit();
+        std::vector<TagWeightRow> out;
+        out.reserve(r.size());
+        for (auto const& row : r) {
+            out.push_back({row["task_id"].as<int>(),
+                           row["tag_id"].as<int>(),
+                           row["base_weight"].as<double>(),
+                           row["alpha"].as<double>(),
+                           row["beta"].as<double>()});
+        }
+        return out;
+    }
+
    private:
     pqxx::connection& c_;
+    WeightDeltaSink*  sink_;
+
+    // 同一列在一個 INSERT ... ON CONFLICT 內只能更新一次，先去重
+    static std::vector<int> distinct(std::vector<int> v) {
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+        return v;
+    }
+
+    void upsert(UnitOfWork&             uow,
+                const char*             stmt,
+                int                     taskId,
+                const std::vector<int>& tagIds,
+                double                  dA,
+                double                  dB) {
+        auto tags = distinct(tagIds);
+        if (tags.empty())
+            return;
+        exec_prepared_timed(uow.tx(), stmt, taskId, to_pg_int_array(tags));
+        uow.after_commit([sink = sink_, taskId, tags, dA, dB] {
+            publish(sink, taskId, tags, dA, dB);
+        });
+    }
+
+    static void publish(WeightDeltaSink*        sink,
+                        int                     taskId,
+                        const std::vector<int>& tagIds,
+                        double                  dA,
+                        double                  dB) {
+        if (!sink || tagIds.empty())
+            return;
+        std::vector<WeightDelta> ds;
+        ds.reserve(tagIds.size());
+        for (int tagId : tagIds) ds.push_back({taskId, tagId, dA, dB});
+        sink->apply(ds);
+    }
 };
@@ -0,0 +1,489 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../db/pool.hpp"
+#include "../repositories/weight_repo.hpp"
+#include "../util/log.hpp"
+#include "../util/mpsc_queue.hpp"
+
+/// Aggregation window for task_tag_weight increments (write-behind)
+/// - submit() splits an event into per-(task_id, tag_id) increments and routes
+///   each key by hash to one shard; the caller only does lock-free enqueues.
+///   Room is reserved on every target shard first, so an event is queued
+///   completely or not at all (a 503 never leaves half an event behind)
+/// - every shard has its own flusher thread that sums increments per key and
+///   writes one row per key with tasktag_apply_deltas (beta = beta + n)
+/// - a shard flushes once its oldest pending increment is flushInterval old or
+///   the batch is full; after a failed write it backs off exponentially
+/// - an idle flusher sleeps until its next deadline (flush, retry or staleness
+///   warning; flushInterval with nothing pending) and a producer wakes it when
+///   it enqueues into a sleeping shard, so an idle ingestor does not poll
+/// - maxStaleness bounds how long an increment may wait: backoff never pushes a
+///   retry past oldest + maxStaleness, and from then on the shard retries every
+///   flushInterval and reports itself stale (stats, /metrics, /health/events)
+/// - a full queue is reported back to the caller (backpressure → 503)
+/// - events naming a task or tag outside Options::known are not queued; the
+///   caller writes them synchronously, so a bad id fails only that request. A
+///   constraint violation at flush time is bisected down to the offending row,
+///   which is dropped and logged while the rest of the batch is written
+/// - stop() drains whatever is queued and flushes it before returning; after
+///   three failed flushes in a row it gives up and logs how much was lost
+class EventIngestor
+{
+   public:
+    struct Options
+    {
+        std::size_t               shards        = 2;
+        std::size_t               queueCapacity = 65536; // 所有 shard 合計
+        std::chrono::milliseconds flushInterval{200};
+        std::chrono::milliseconds maxStaleness{2000}; // 增量最多在記憶體裡待多久
+        std::size_t               maxBatch = 2000; // 每個 shard 每次最多幾個 key
+        bool includeAdopt = true; // false：只聚合 skip/impression，adopt 同步寫入
+        // 已知的 task/tag（例如 tag 字典 + 常駐推薦索引）；空的話不檢查
+        std::function<bool(int taskId, const std::vector<int>& tagIds)> known;
+    };
+
+    struct Stats
+    {
+        std::uint64_t             accepted;      // 受理的事件
+        std::uint64_t             rejected;      // 佇列滿被拒絕
+        std::uint64_t             increments;    // 進入視窗的 (task, tag) 增量
+        std::uint64_t             flushedRows;   // 實際寫入的 (task, tag) 列數
+        std::uint64_t             flushes;       // 成功的批次數
+        std::uint64_t             flushFailures; // 失敗（退避後重試）的批次數
+        std::uint64_t             droppedRows;   // 違反約束而丟棄的列數
+        std::size_t               queueDepth;    // 目前佇列長度（近似，全部 shard）
+        std::size_t               queueHighWater;
+        std::size_t               queueCapacity;
+        std::chrono::milliseconds oldestPending; // 最久沒寫入的增量等了多久
+        std::size_t               staleShards;   // 超過 maxStaleness 的 shard 數
+    };
+
+    enum class SubmitResult
+    {
+        Queued,
+        Full,
+        Unknown, // task 或 tag 不在 Options::known：呼叫端改走同步寫入
+        Ignored  // 未知事件或沒有 tag：與同步模式一樣直接略過
+    };
+
+    // 佇列滿（由 EventService 丟出，controller 轉成 503）
+    struct QueueFull : std::runtime_error
+    {
+        QueueFull() : std::runtime_error("event_queue_full") {}
+    };
+
+    EventIngestor(DbPool& pool, WeightDeltaSink* sink, Options opt)
+        : pool_(pool), sink_(sink), opt_(opt) {
+        opt_.shards       = std::max<std::size_t>(1, opt_.shards);
+        opt_.maxStaleness = std::max(opt_.maxStaleness, opt_.flushInterval);
+        const std::size_t perCap =
+            std::max<std::size_t>(2, opt_.queueCapacity / opt_.shards);
+        for (std::size_t i = 0; i < opt_.shards; ++i)
+            shards_.push_back(std::make_unique<Shard>(perCap));
+    }
+
+    ~EventIngestor() { stop(); }
+
+    EventIngestor(const EventIngestor&)            = delete;
+    EventIngestor& operator=(const EventIngestor&) = delete;
+
+    void start() {
+        for (auto& sh : shards_) {
+            if (sh->flusher.joinable())
+                continue;
+            sh->stopping.store(false, std::memory_order_relaxed);
+            sh->flusher = std::thread([this, s = sh.get()] { run(*s); });
+        }
+    }
+
+    /// Drain queued increments and flush them; safe to call more than once
+    void stop() {
+        for (auto& sh : shards_) {
+            sh->stopping.store(true, std::memory_order_release);
+            std::lock_guard<std::mutex> lk(sh->m);
+            sh->cv.notify_one();
+        }
+        for (auto& sh : shards_)
+            if (sh->flusher.joinable())
+                sh->flusher.join();
+    }
+
+    /// Whether events of this type go through the window (others stay synchronous)
+    bool accepts(const std::string& event) const {
+        if (event == "skip" || event == "impression")
+            return true;
+        return opt_.includeAdopt && event == "adopt";
+    }
+
+    /// Whether every id is known, i.e. the event can be acknowledged before the
+    /// write without risking a constraint violation in the batch
+    bool knows(int taskId, const std::vector<int>& tagIds) const {
+        return !opt_.known || opt_.known(taskId, tagIds);
+    }
+
+    SubmitResult submit(int                     taskId,
+                        const std::string&      event,
+                        const std::vector<int>& tagIds) {
+        if (taskId <= 0 || tagIds.empty() || !accepts(event))
+            return SubmitResult::Ignored;
+        if (!knows(taskId, tagIds))
+            return SubmitResult::Unknown;
+        const bool adopt = event == "adopt";
+
+        // 先算出每個 key 的 shard，依 shard 排好，再逐 shard 保留空位
+        std::vector<std::pair<Shard*, std::uint64_t>> items;
+        items.reserve(tagIds.size());
+        for (std::size_t i = 0; i < tagIds.size(); ++i) {
+            const int tagId = tagIds[i];
+            // 同一事件內重複的 tag 只算一次（與同步路徑一致）
+            const auto seen = tagIds.begin() + static_cast<std::ptrdiff_t>(i);
+            if (std::find(tagIds.begin(), seen, tagId) != seen)
+                continue;
+            const std::uint64_t key = key_of(taskId, tagId);
+            items.emplace_back(shards_[mix(key) % shards_.size()].get(), key);
+        }
+        std::sort(items.begin(), items.end(), [](auto const& a, auto const& b) {
+            return a.first < b.first;
+        });
+
+        // 任何一個 shard 放不下就退回已保留的，整個事件都不排入
+        for (std::size_t i = 0; i < items.size();) {
+            const std::size_t n = run_length(items, i);
+            if (!items[i].first->queue.try_reserve(n)) {
+                for (std::size_t j = 0; j < i; j += run_length(items, j))
+                    items[j].first->queue.cancel_reservation(run_length(items, j));
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return SubmitResult::Full;
+            }
+            i += n;
+        }
+        for (auto const& [sh, key] : items) {
+            sh->queue.push_reserved(Item{key, adopt});
+            sh->increments.fetch_add(1, std::memory_order_relaxed);
+            note_depth(sh->queue.size_approx());
+        }
+        for (std::size_t i = 0; i < items.size(); i += run_length(items, i))
+            wake(*items[i].first);
+        accepted_.fetch_add(1, std::memory_order_relaxed);
+        return SubmitResult::Queued;
+    }
+
+    Stats stats() const {
+        Stats st{};
+        st.accepted       = accepted_.load(std::memory_order_relaxed);
+        st.rejected       = rejected_.load(std::memory_order_relaxed);
+        st.queueHighWater = highWater_.load(std::memory_order_relaxed);
+        for (auto const& sh : shards_) {
+            st.increments += sh->increments.load(std::memory_order_relaxed);
+            st.flushedRows += sh->flushedRows.load(std::memory_order_relaxed);
+            st.flushes += sh->flushes.load(std::memory_order_relaxed);
+            st.flushFailures += sh->flushFailures.load(std::memory_order_relaxed);
+            st.droppedRows += sh->droppedRows.load(std::memory_order_relaxed);
+            st.queueDepth += sh->queue.size_approx();
+            st.queueCapacity += sh->queue.capacity();
+            const auto since = sh->oldestNs.load(std::memory_order_relaxed);
+            if (since == 0)
+                continue;
+            const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(
+                clock::now().time_since_epoch() - clock::duration(since));
+            st.oldestPending = std::max(st.oldestPending, age);
+            st.staleShards += age >= opt_.maxStaleness ? 1 : 0;
+        }
+        return st;
+    }
+
+    std::size_t shard_count() const { return shards_.size(); }
+
+   private:
+    using clock = std::chrono::steady_clock;
+
+    struct Item
+    {
+        std::uint64_t key   = 0; // task_id << 32 | tag_id
+        bool          adopt = false;
+    };
+
+    // 同一視窗內同一 (task, tag) 的合併結果；insert_* 依序模擬單筆 upsert：
+    // 第一筆建立 (1.0, 9.0)，之後每筆才累加
+    struct Pending
+    {
+        double dAlpha   = 0.0;
+        double dBeta    = 0.0;
+        double insAlpha = 1.0;
+        double insBeta  = 9.0;
+    };
+
+    struct Shard
+    {
+        explicit Shard(std::size_t capacity) : queue(capacity) {}
+
+        BoundedMpscQueue<Item> queue;
+        std::thread            flusher;
+        std::atomic<bool>      stopping{false};
+
+        // flusher 睡著時 producer 用來叫醒它（wake 由 m 保護）
+        std::mutex              m;
+        std::condition_variable cv;
+        std::atomic<bool>       sleeping{false};
+        bool                    wake = false;
+
+        // 只由該 shard 的 flusher thread 使用
+        std::unordered_map<std::uint64_t, Pending> pending;
+        clock::time_point                          oldest{};    // 視窗內最舊一筆
+        clock::time_point                          retryAt{};   // 失敗後的退避期限
+        std::chrono::milliseconds                  backoff{0};
+        bool                                       staleWarned = false;
+
+        // oldest 的 steady_clock tick（0：pending 為空），給 stats() 讀
+        std::atomic<clock::rep> oldestNs{0};
+
+        std::atomic<std::uint64_t> increments{0};
+        std::atomic<std::uint64_t> flushedRows{0};
+        std::atomic<std::uint64_t> flushes{0};
+        std::atomic<std::uint64_t> flushFailures{0};
+        std::atomic<std::uint64_t> droppedRows{0};
+    };
+
+    DbPool&                             pool_;
+    WeightDeltaSink*                    sink_;
+    Options                             opt_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<std::uint64_t> accepted_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+    std::atomic<std::size_t>   highWater_{0};
+
+    static std::uint64_t key_of(int taskId, int tagId) {
+        const auto hi =
+            static_cast<std::uint64_t>(static_cast<std::uint32_t>(taskId));
+        return (hi << 32) | static_cast<std::uint32_t>(tagId);
+    }
+
+    // splitmix64 finalizer：同一熱門 task 的不同 tag 也會分散到不同 shard
+    static std::uint64_t mix(std::uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static void set_oldest(Shard& sh, clock::time_point t) {
+        sh.oldest      = t;
+        sh.staleWarned = false;
+        sh.oldestNs.store(t.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    // items[i] 起同一個 shard 的筆數（items 依 shard 排序）
+    template <typename V>
+    static std::size_t run_length(const V& items, std::size_t i) {
+        std::size_t j = i + 1;
+        while (j < items.size() && items[j].first == items[i].first) ++j;
+        return j - i;
+    }
+
+    void note_depth(std::size_t depth) {
+        std::size_t hw = highWater_.load(std::memory_order_relaxed);
+        while (depth > hw && !highWater_.compare_exchange_weak(
+                                 hw, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    void run(Shard& sh) {
+        while (!sh.stopping.load(std::memory_order_acquire)) {
+            drain(sh);
+            const auto now = clock::now();
+            const bool        due     = now - sh.oldest >= opt_.flushInterval ||
+                                sh.pending.size() >= opt_.maxBatch;
+
+            if (!sh.pending.empty() && due && now >= sh.retryAt)
+                flush(sh);
+            if (!sh.pending.empty() && !sh.staleWarned &&
+                now - sh.oldest >= opt_.maxStaleness) {
+                sh.staleWarned = true; // 寫成功清空 pending 前只警告一次
+                TP_LOG_WARN("event ingestor shard is stale",
+                            log_kv("rows", sh.pending.size()),
+                            log_kv("maxStalenessMs", opt_.maxStaleness.count()));
+            }
+            sleep_until(sh, next_wake(sh, clock::now()));
+        }
+        shutdown(sh);
+    }
+
+    // 下一個要處理的時間點：flush 期限（失敗時取退避期限）與 stale 警告；
+    // pending 為空時最多睡一個 flushInterval
+    clock::time_point next_wake(const Shard& sh, clock::time_point now) const {
+        if (sh.pending.empty())
+            return now + opt_.flushInterval;
+        if (sh.pending.size() >= opt_.maxBatch && sh.retryAt <= now)
+            return now; // 滿批且不在退避中：馬上再 flush
+        auto at = std::max(sh.oldest + opt_.flushInterval, sh.retryAt);
+        if (!sh.staleWarned)
+            at = std::min(at, sh.oldest + opt_.maxStaleness);
+        return at;
+    }
+
+    // 先標記 sleeping 再確認佇列是空的（與 wake() 的「先 push 再看 sleeping」
+    // 配對，兩邊都有 seq_cst fence），不會錯過剛排入的增量
+    void sleep_until(Shard& sh, clock::time_point until) {
+        std::unique_lock<std::mutex> lk(sh.m);
+        sh.sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // pending 滿了就算有新增量也拿不進來，只等期限
+        const bool room = sh.pending.size() < opt_.maxBatch;
+        if (!room || sh.queue.size_approx() == 0)
+            sh.cv.wait_until(lk, until, [&] {
+                return (room && sh.wake) ||
+                       sh.stopping.load(std::memory_order_acquire);
+            });
+        sh.wake = false;
+        sh.sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    static void wake(Shard& sh) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sh.sleeping.load(std::memory_order_relaxed))
+            return;
+        std::lock_guard<std::mutex> lk(sh.m);
+        sh.wake = true;
+        sh.cv.notify_one();
+    }
+
+    // 關機：drain + flush 直到佇列清空；連續失敗 kShutdownAttempts 次就放棄，
+    // 並回報沒寫進 DB 的 pending 列與還在佇列裡的增量
+    void shutdown(Shard& sh) {
+        constexpr int kShutdownAttempts = 3;
+        int           failures          = 0;
+        for (;;) {
+            drain(sh); // pending 沒滿就表示佇列已空
+            if (sh.pending.empty())
+                break;
+            if (flush(sh))
+                failures = 0;
+            else if (++failures >= kShutdownAttempts)
+                break;
+            else
+                std::this_thread::sleep_for(opt_.flushInterval);
+        }
+        std::size_t queued = 0;
+        for (Item it; sh.queue.try_pop(it);) ++queued;
+        if (!sh.pending.empty() || queued)
+            TP_LOG_WARN("event ingestor dropped rows on shutdown",
+                        log_kv("pending", sh.pending.size()),
+                        log_kv("queued", queued));
+    }
+
+    std::size_t drain(Shard& sh) {
+        std::size_t n = 0;
+        Item        it;
+        while (sh.pending.size() < opt_.maxBatch && sh.queue.try_pop(it)) {
+            ++n;
+            if (sh.pending.empty())
+                set_oldest(sh, clock::now()); // 視窗從第一筆增量起算
+            auto [pos, fresh] = sh.pending.try_emplace(it.key);
+            Pending& p        = pos->second;
+            if (!fresh) {
+                p.insAlpha += it.adopt ? 1.0 : 0.0;
+                p.insBeta += it.adopt ? 0.0 : 1.0;
+            }
+            p.dAlpha += it.adopt ? 1.0 : 0.0;
+            p.dBeta += it.adopt ? 0.0 : 1.0;
+        }
+        return n;
+    }
+
+    bool flush(Shard& sh) {
+        try {
+            // 每次從 pending 重組：連線重試時不會重寫已寫入的部分
+            pool_.run([&](pqxx::connection& c) {
+                WeightRepo  repo(c, sink_);
+                const auto ds = sorted_pending(sh);
+                write(sh, repo, ds, 0, ds.size());
+            });
+            sh.backoff = std::chrono::milliseconds(0);
+            sh.retryAt = {};
+            if (sh.pending.empty())
+                set_oldest(sh, {});
+            sh.flushes.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        catch (const std::exception& e) {
+            // 沒寫入的 pending 留著，退避後連同新增量一起重試；重試不晚於
+            // oldest + maxStaleness，過了期限就每個 flushInterval 試一次
+            const auto now      = clock::now();
+            const auto deadline = sh.oldest + opt_.maxStaleness;
+            sh.backoff = std::min(opt_.maxStaleness,
+                                  std::max(opt_.flushInterval, sh.backoff * 2));
+            sh.retryAt = std::min(now + sh.backoff,
+                                  std::max(deadline, now + opt_.flushInterval));
+            sh.flushFailures.fetch_add(1, std::memory_order_relaxed);
+            TP_LOG_WARN("event ingestor flush failed", log_kv("error", e.what()));
+            return false;
+        }
+    }
+
+    static std::vector<WeightDelta> sorted_pending(const Shard& sh) {
+        std::vector<WeightDelta> ds;
+        ds.reserve(sh.pending.size());
+        for (auto const& kv : sh.pending) {
+            const int   taskId = static_cast<int>(kv.first >> 32);
+            const int   tagId  = static_cast<int>(kv.first & 0xffffffffu);
+            const auto& p      = kv.second;
+            ds.push_back({taskId, tagId, p.dAlpha, p.dBeta, p.insAlpha, p.insBeta});
+        }
+        // 固定加鎖順序，降低與同步寫入互鎖的機會
+        std::sort(ds.begin(), ds.end(), [](auto const& a, auto const& b) {
+            return a.task_id != b.task_id ? a.task_id < b.task_id
+                                          : a.tag_id < b.tag_id;
+        });
+        return ds;
+    }
+
+    // 寫入 ds[first, last)，寫入的 key 移出 pending。違反約束（task/tag 不存在）
+    // 時對半拆開重試，最後只丟掉出錯的那一列；其他錯誤往外丟，整批退避重試
+    void write(Shard&                          sh,
+               WeightRepo&                     repo,
+               const std::vector<WeightDelta>& ds,
+               std::size_t                     first,
+               std::size_t                     last) {
+        if (first == last)
+            return;
+        const std::vector<WeightDelta> part(ds.begin() + first, ds.begin() + last);
+        try {
+            repo.apply_deltas(part);
+        }
+        catch (const pqxx::integrity_constraint_violation& e) {
+            if (part.size() > 1) {
+                const std::size_t mid = first + part.size() / 2;
+                write(sh, repo, ds, first, mid);
+                write(sh, repo, ds, mid, last);
+                return;
+            }
+            const auto& d = part.front();
+            sh.pending.erase(key_of(d.task_id, d.tag_id));
+            sh.droppedRows.fetch_add(1, std::memory_order_relaxed);
+            TP_LOG_SAMPLED(LogLevel::Warn,
+                           20,
+                           "event ingestor dropped row",
+                           log_kv("taskId", d.task_id),
+                           log_kv("tagId", d.tag_id),
+                           log_kv("error", e.what()));
+            return;
+        }
+        for (auto const& d : part) sh.pending.erase(key_of(d.task_id, d.tag_id));
+        sh.flushedRows.fetch_add(part.size(), std::memory_order_relaxed);
+    }
+};
@@ -1,13 +1,25 @@
 #pragma once
 #include <pqxx/pqxx>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "../repositories/weight_repo.hpp"
+#include "../util/log.hpp"
+#include "event_ingestor.hpp"
 
 class EventService
 {
    public:
-    explicit EventService(pqxx::connection& c) : c_(c), weightRepo_(c) {}
+    // sink：DB 寫入後同步套用增量（例如常駐推薦索引），可為 nullptr
+    // window：聚合視窗；它接受的事件改為排入視窗、批次合併寫入，可為 nullptr
+    explicit EventService(pqxx::connection& c,
+                          WeightDeltaSink*  sink   = nullptr,
+                          EventIngestor*    window = nullptr)
+        : c_(&c), weightRepo_(std::in_place, c, sink), window_(window) {}
+
+    // 只處理視窗接受的事件（不需要連線）
+    explicit EventService(EventIngestor& window) : window_(&window) {}
 
     void handle_event(int                     taskId,
                       const std::string&      event,
@@ -15,36 +27,39 @@ class EventService
         if (taskId <= 0 || event.empty())
             return;
 
+        if (window_ && window_->accepts(event)) {
+            using Result     = EventIngestor::SubmitResult;
+            const Result res = window_->submit(taskId, event, tagIds);
+            if (res == Result::Full)
+                throw EventIngestor::QueueFull();
+            if (res != Result::Unknown)
+                return;
+            // 不認得的 task/tag 不進視窗：同步寫入，出錯只影響這個請求
+            if (!weightRepo_)
+                throw std::runtime_error("unknown task or tag for queued event");
+        }
+        if (!weightRepo_)
+            return; // 沒有連線：只能處理視窗事件
+
         if (event == "adopt") {
             if (!tagIds.empty())
-                weightRepo_.reinforce(taskId, tagIds);
-            std::cout << "[DEBUG] adopt taskId=" << taskId << " tags=";
-            for (size_t i = 0; i < tagIds.size(); ++i) {
-                if (i)
-                    std::cout << ',';
-                std::cout << tagIds[i];
-            }
-            std::cout << " at " << std::time(nullptr) << std::endl;
+                weightRepo_->reinforce(taskId, tagIds);
+            TP_LOG_SAMPLED(LogLevel::Debug,
+                           20,
+                           "adopt",
+                           log_kv("taskId", taskId),
+                           log_kv("tags", tagIds));
             return;
         }
 
         if (event == "skip" || event == "impression") {
-            pqxx::work tx(c_);
-            for (int tagId : tagIds) {
-                tx.exec_params(
-                    R"(INSERT INTO task_tag_weight (task_id, tag_id, base_weight, alpha, beta)
-             VALUES ($1,$2,0.5,1.0,9.0)
-             ON CONFLICT (task_id, tag_id)
-             DO UPDATE SET beta = task_tag_weight.beta + 1.0,
-                           updated_at = now())",
-                    taskId,
-                    tagId);
-            }
-            tx.commit();
+            if (!tagIds.empty())
+                weightRepo_->penalize(taskId, tagIds);
         }
     }
 
    private:
-    pqxx::connection& c_;
-    WeightRepo        weightRepo_;
+    pqxx::connection*         c_ = nullptr;
+    std::optional<WeightRepo> weightRepo_;
+    EventIngestor*            window_ = nullptr;
 };
@@ -2,9 +2,15 @@
 #include <pqxx/pqxx>
 #include <vector>
 #include <string>
-#include <cmath>
 #include <algorithm>
+#include <optional>
+#include <utility>
+#include "../domain/ranking_profile.hpp"
+#include "../domain/tag_set.hpp"
 #include "../repositories/task_repo.hpp"
+#include "../index/recommend_index.hpp"
+#include "../index/score_kernel.hpp"
+#include "../util/random.hpp"
 
 struct RecommendItem
 {
@@ -18,15 +24,43 @@ struct RecommendItem
     double      finalScore;
 };
 
+// Thompson sampling：tag_fit 裡的 Beta 平均改成從 Beta(alpha, beta) 抽一個樣本，
+// 觀察少（分布寬）的 (task, tag) 有機會排上來；只在 memory 模式生效
+// seed 0 = 每個 thread 自己的亂數流；非 0 時相同輸入得到相同結果（測試、benchmark）
+struct ExploreOptions
+{
+    bool          enabled = false;
+    std::uint64_t seed    = 0;
+};
+
+// profile 為空或等於預設權重時走編譯期常數的特化版本
 class RecommendService
 {
    public:
-    explicit RecommendService(pqxx::connection& c) : c_(c), tasks_(c) {}
+    // db 模式：每次走 recommend_query
+    explicit RecommendService(pqxx::connection&     c,
+                              const RankingProfile* profile = nullptr)
+        : c_(&c), tasks_(std::in_place, c), weights_(custom_weights(profile)) {}
+    // memory 模式：只讀常駐索引，不需要連線
+    explicit RecommendService(const RecommendIndex& index,
+                              const RankingProfile* profile = nullptr)
+        : index_(&index), weights_(custom_weights(profile)) {}
+
+    // 依 finalScore 取前 limit 筆（先排序再截斷），同分時新任務優先
+    std::vector<RecommendItem> recommend(const TagSet&         tags,
+                                         int                   timeMinutes,
+                                         int                   limit,
+                                         const ExploreOptions& explore = {}) {
+        if (index_ && explore.enabled) {
+            // 取樣器與種子化的產生器都在 stack 上，不配置記憶體
+            Xoshiro256  seeded(explore.seed);
+            BetaSampler sampler(explore.seed ? seeded : Xoshiro256::per_thread());
+            return recommend_in_memory(&sampler, tags, timeMinutes, limit);
+        }
+        if (index_)
+            return recommend_in_memory(nullptr, tags, timeMinutes, limit);
 
-    std::vector<RecommendItem> recommend(const std::vector<int>& tagIds,
-                                         int                     timeMinutes,
-                                         int                     limit) {
-        auto                       rows = tasks_.recommend_rows(tagIds, limit);
+        auto rows = tasks_->recommend_rows(tags, timeMinutes, limit, weights_);
         std::vector<RecommendItem> out;
         out.reserve(rows.size());
         for (auto const& row : rows) {
@@ -35,27 +69,139 @@ class RecommendService
             it.description     = row["description"].as<std::string>();
             it.suggestedTime   = row["suggested_time"].as<int>();
             it.tagFit          = row["tag_fit"].as<double>();
-            it.timeFit         = time_fit(timeMinutes, it.suggestedTime);
+            it.timeFit         = row["time_fit"].as<double>();
             it.scoreQuality    = row["score_quality"].as<double>();
             it.scorePopularity = row["score_popularity"].as<double>();
-            it.finalScore      = 0.55 * it.tagFit + 0.25 * it.timeFit +
-                            0.12 * it.scoreQuality + 0.08 * it.scorePopularity;
+            it.finalScore      = row["final_score"].as<double>();
             out.push_back(std::move(it));
         }
-        std::sort(out.begin(), out.end(), [](auto const& a, auto const& b) {
-            return a.finalScore > b.finalScore;
-        });
         return out;
     }
 
    private:
-    pqxx::connection& c_;
-    TaskRepo          tasks_;
-
-    static double time_fit(int userMin, int sugMin) {
-        const double eps = 1e-6;
-        if (userMin <= 0 || sugMin <= 0)
-            return 0.8;
-        return std::exp(-std::fabs(std::log((userMin + eps) / (sugMin + eps))));
+    pqxx::connection*       c_ = nullptr;
+    std::optional<TaskRepo> tasks_;
+    const RecommendIndex*   index_ = nullptr;
+    const RankingWeights*   weights_; // nullptr = DefaultRanking
+
+    static const RankingWeights* custom_weights(const RankingProfile* p) {
+        return p && !p->weights.is_default() ? &p->weights : nullptr;
     }
+
+    // Top-K：
+    // 1) 沿 posting list 累加 tag_fit（AVG(base*bw + mean*alpha/(alpha+beta))）
+    //    的分子；分母（命中 tag 數）= 查詢與任務 tag mask 交集的 popcount
+    // 2) 全部任務計分（無命中 tag_fit = 0.1，與 recommend_query 同義），
+    //    整欄交給 scoring::score（AVX2 / scalar）
+    // 3) 大小 K 的 heap 選取，只實體化 K 筆
+    std::vector<RecommendItem> recommend_in_memory(BetaSampler*  sampler,
+                                                   const TagSet& tags,
+                                                   int           timeMinutes,
+                                                   int           limit) const {
+        if (weights_)
+            return recommend_in_memory(*weights_, sampler, tags, timeMinutes, limit);
+        return recommend_in_memory(
+            DefaultRanking{}, sampler, tags, timeMinutes, limit);
+    }
+
+    // sampler 非空時 Beta 平均改為抽樣（Thompson sampling）
+    template <typename W>
+    std::vector<RecommendItem> recommend_in_memory(const W&      w,
+                                                   BetaSampler*  sampler,
+                                                   const TagSet& tags,
+                                                   int           timeMinutes,
+                                                   int           limit) const {
+        return index_->read([&](const RecommendIndex::Data& d) {
+            std::vector<RecommendItem> out;
+            const auto&                tasks = d.tasks;
+            const int                  n     = static_cast<int>(tasks.size());
+            const int                  k     = std::min(limit, n);
+            if (k <= 0)
+                return out;
+
+            // 每個 worker thread 重用的暫存（避免每次請求配置）
+            thread_local std::vector<double>                 fitSum;
+            thread_local std::vector<int>                    fitCnt;
+            thread_local std::vector<double>                 scores;
+            thread_local std::vector<std::pair<double, int>> heap;
+
+            // 超出 mask 寬度的 tag id 才需要沿 posting 計數
+            const bool overflow = tags.has_overflow();
+            fitSum.assign(n, 0.0);
+            if (overflow)
+                fitCnt.assign(n, 0);
+
+            tags.for_each([&](int tagId) {
+                auto* list = d.postings_for(tagId);
+                if (!list)
+                    return;
+                const bool countHere = !TagSet::is_inline(tagId);
+                for (auto const& p : *list) {
+                    const double denom = p.alpha + p.beta;
+                    if (denom == 0.0)
+                        continue; // NULLIF：AVG 忽略
+                    const double m =
+                        sampler ? sampler->beta(p.alpha, p.beta) : p.alpha / denom;
+                    fitSum[p.slot] += w.base * p.base_weight + w.mean * m;
+                    if (countHere)
+                        ++fitCnt[p.slot];
+                }
+            });
+            auto matched = [&](int slot) {
+                const int cnt =
+                    static_cast<int>(tags.intersect_count(tasks.tag_mask[slot]));
+                return overflow ? cnt + fitCnt[slot] : cnt;
+            };
+            // fitSum 就地換成 tag_fit，當作 kernel 的輸入欄
+            for (int slot = 0; slot < n; ++slot)
+                fitSum[slot] = tag_fit(fitSum[slot], matched(slot));
+
+            scores.resize(n);
+            const scoring::Columns cols{fitSum.data(),
+                                        tasks.suggested_time.data(),
+                                        tasks.score_quality.data(),
+                                        tasks.score_popularity.data()};
+            scoring::score(cols, w, timeMinutes, n, scores.data());
+
+            // (score, slot)；better() 為 heap 的比較子 → heap 頂端是目前最差的一筆
+            auto better = [](const std::pair<double, int>& a,
+                             const std::pair<double, int>& b) {
+                return a.first > b.first ||
+                       (a.first == b.first && a.second < b.second);
+            };
+            heap.clear();
+            heap.reserve(k);
+            for (int slot = 0; slot < n; ++slot) {
+                const std::pair<double, int> cand{scores[slot], slot};
+                if (static_cast<int>(heap.size()) < k) {
+                    heap.push_back(cand);
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+                else if (better(cand, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = cand;
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+            }
+            std::sort_heap(heap.begin(), heap.end(), better); // 最佳者在前
+
+            out.reserve(heap.size());
+            for (auto const& hs : heap) {
+                const int     slot = hs.second;
+                RecommendItem it;
+                it.id              = tasks.id[slot];
+                it.description     = tasks.description[slot];
+                it.suggestedTime   = tasks.suggested_time[slot];
+                it.tagFit          = fitSum[slot];
+                it.scoreQuality    = tasks.score_quality[slot];
+                it.scorePopularity = tasks.score_popularity[slot];
+                it.finalScore      = hs.first;
+                it.timeFit = scoring::time_fit(timeMinutes, it.suggestedTime);
+                out.push_back(std::move(it));
+            }
+            return out;
+        });
+    }
+
+    static double tag_fit(double sum, int cnt) { return cnt ? sum / cnt : 0.1; }
 };
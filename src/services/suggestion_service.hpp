@@ -6,6 +6,9 @@
 #include "../repositories/task_repo.hpp"
 #include "../repositories/suggestion_repo.hpp"
 #include "../repositories/weight_repo.hpp"
+#include "../db/pipeline.hpp"
+#include "../db/unit_of_work.hpp"
+#include "../index/trigram_index.hpp"
 
 struct SuggestionResult
 {
@@ -18,54 +21,75 @@ struct SuggestionResult
 class SuggestionService
 {
    public:
-    explicit SuggestionService(pqxx::connection& c, double simThreshold = 0.87)
+    explicit SuggestionService(pqxx::connection&   c,
+                               double              simThreshold = 0.87,
+                               WeightDeltaSink*    sink         = nullptr,
+                               const TrigramIndex* trigrams     = nullptr)
         : c_(c),
           taskRepo_(c),
           suggRepo_(c),
-          weightRepo_(c),
+          weightRepo_(c, sink),
+          trigrams_(trigrams),
           simThreshold_(simThreshold) {}
 
     SuggestionResult create_or_alias(const std::string&      description,
                                      int                     suggestedTime,
                                      const std::vector<int>& tagIds) {
-        // 1) 找相似任務
-        auto cands = taskRepo_.find_similar(description, simThreshold_, /*limit*/ 1);
+        // 整個提交只有一個交易、一次 commit：任何一步失敗全部回滾，
+        // 不會留下沒有 alias 的 merged suggestion；權重增量在 commit 後才套用
+        UnitOfWork uow(c_);
+
+        // 1) 找相似任務（後續寫入取決於結果，必須先等它回來）
+        //    有常駐 trigram 索引時在記憶體裡找，不必掃 tasks
+        auto cands =
+            trigrams_
+                ? trigrams_->find_similar(description, simThreshold_, /*limit*/ 1)
+                : taskRepo_.find_similar(uow, description, simThreshold_, 1);
+
+        // 2) 其餘寫入排進同一個 pipeline，一次 round trip 送出
+        Pipeline   p(uow);
+        const auto lastId = SuggestionRepo::last_inserted_id();
         if (!cands.empty()) {
             // 命中：建立 merged 的 suggestion、寫 alias、強化該任務的權重
             int    taskId = cands.front().id;
             double sim    = cands.front().similarity;
 
-            int suggId =
-                suggRepo_.insert(description, suggestedTime, "merged", /*votes*/ 1);
-            suggRepo_.upsert_alias(suggId, taskId, sim);
+            auto ins = suggRepo_.insert(
+                p, description, suggestedTime, "merged", /*votes*/ 1);
+            suggRepo_.upsert_alias(p, lastId, taskId, sim);
             if (!tagIds.empty())
-                weightRepo_.reinforce(taskId, tagIds);
+                weightRepo_.reinforce(p, taskId, tagIds);
+            p.flush();
+            uow.commit();
 
             SuggestionResult r;
             r.merged        = true;
-            r.suggestionId  = suggId;
+            r.suggestionId  = SuggestionRepo::inserted_id(p.result(ins));
             r.matchedTaskId = taskId;
             r.similarity    = sim;
             return r;
         }
 
         // 未命中：進 buffer 並附上 tags
-        int suggId =
-            suggRepo_.insert(description, suggestedTime, "pending", /*votes*/ 1);
+        auto ins =
+            suggRepo_.insert(p, description, suggestedTime, "pending", /*votes*/ 1);
         if (!tagIds.empty())
             suggRepo_.insert_tags(
-                suggId, tagIds, /*baseWeight*/ 0.6, /*alpha*/ 1.0, /*beta*/ 9.0);
+                p, lastId, tagIds, /*baseWeight*/ 0.6, /*alpha*/ 1.0, /*beta*/ 9.0);
+        p.flush();
+        uow.commit();
 
         SuggestionResult r;
         r.merged       = false;
-        r.suggestionId = suggId;
+        r.suggestionId = SuggestionRepo::inserted_id(p.result(ins));
         return r;
     }
 
    private:
-    pqxx::connection& c_;
-    TaskRepo          taskRepo_;
-    SuggestionRepo    suggRepo_;
-    WeightRepo        weightRepo_;
-    double            simThreshold_;
+    pqxx::connection&   c_;
+    TaskRepo            taskRepo_;
+    SuggestionRepo      suggRepo_;
+    WeightRepo          weightRepo_;
+    const TrigramIndex* trigrams_;
+    double              simThreshold_;
 };
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+
+#ifdef TP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/// gzip-compress a buffer (zlib deflate with a gzip header)
+/// - returns an empty string when the build has no zlib (TP_HAVE_ZLIB unset) or
+///   compression fails; callers then serve the identity body
+inline std::string gzip_compress(const std::string& in) {
+#ifdef TP_HAVE_ZLIB
+    z_stream zs{};
+    // windowBits 15 + 16：輸出 gzip 格式而不是 zlib 格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return {};
+    std::string out(deflateBound(&zs, static_cast<uLong>(in.size())), '\0');
+    zs.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in  = static_cast<uInt>(in.size());
+    zs.next_out  = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END ? out : std::string();
+#else
+    (void)in;
+    return {};
+#endif
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/// Lock-free latency histogram with power-of-two microsecond buckets
+/// - bucket i counts samples <= 2^i µs (bucket 0: <= 1 µs); the last bucket is +Inf
+/// - record() is a few relaxed atomic adds, safe from any thread
+/// - snapshot() counts are per bucket (not cumulative)
+class LatencyHistogram
+{
+   public:
+    static constexpr std::size_t kBuckets = 24; // 最後一個有限上界 2^22 µs ≈ 4.2 s
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, kBuckets> counts{};
+        std::uint64_t                       count     = 0;
+        std::uint64_t                       sumMicros = 0;
+    };
+
+    /// Upper bound of bucket i in seconds; the last bucket has no finite bound
+    static double upper_bound_sec(std::size_t i) {
+        return static_cast<double>(std::uint64_t{1} << i) / 1e6;
+    }
+
+    template <typename Rep, typename Period>
+    void record(const std::chrono::duration<Rep, Period>& d) {
+        const auto us =
+            std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        const std::uint64_t v = us > 0 ? static_cast<std::uint64_t>(us) : 0;
+        buckets_[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sumMicros_.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        for (std::size_t i = 0; i < kBuckets; ++i)
+            s.counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        s.count     = count_.load(std::memory_order_relaxed);
+        s.sumMicros = sumMicros_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+   private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+    std::atomic<std::uint64_t>                       count_{0};
+    std::atomic<std::uint64_t>                       sumMicros_{0};
+
+    // ceil(log2(v))：v <= 2^i 的最小 i
+    static std::size_t bucket_of(std::uint64_t v) {
+        std::size_t i = 0;
+        while (i + 1 < kBuckets && (std::uint64_t{1} << i) < v) ++i;
+        return i;
+    }
+};
@@ -0,0 +1,406 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 編譯期下限：低於此等級的 TP_LOG_* 整段被編譯器移除
+// 0=debug 1=info 2=warn 3=error；例：-DTP_LOG_MIN_LEVEL=1
+#ifndef TP_LOG_MIN_LEVEL
+#define TP_LOG_MIN_LEVEL 0
+#endif
+
+enum class LogLevel : int
+{
+    Debug = 0,
+    Info  = 1,
+    Warn  = 2,
+    Error = 3,
+    Off   = 4
+};
+
+inline LogLevel parse_log_level(std::string_view s, LogLevel fallback) {
+    if (s == "debug")
+        return LogLevel::Debug;
+    if (s == "info")
+        return LogLevel::Info;
+    if (s == "warn")
+        return LogLevel::Warn;
+    if (s == "error")
+        return LogLevel::Error;
+    if (s == "off")
+        return LogLevel::Off;
+    return fallback;
+}
+
+// 結構化欄位：TP_LOG_INFO("adopt", log_kv("taskId", id)) → "adopt taskId=5"
+template <typename T>
+struct LogField
+{
+    const char* key;
+    const T&    value;
+};
+
+template <typename T>
+LogField<T> log_kv(const char* key, const T& value) {
+    return {key, value};
+}
+
+/// Fixed-size line buffer a record is formatted into on the calling thread
+/// - never allocates; text past the buffer is cut and marked with "~"
+/// - integers use to_chars, floating point "%g", sequences are joined by ','
+class LogLine
+{
+   public:
+    LogLine(char* buf, std::size_t cap) : p_(buf), begin_(buf), end_(buf + cap) {}
+
+    std::size_t size() const { return static_cast<std::size_t>(p_ - begin_); }
+
+    void put(std::string_view s) {
+        const std::size_t room = static_cast<std::size_t>(end_ - p_);
+        const std::size_t n    = std::min(room, s.size());
+        std::memcpy(p_, s.data(), n);
+        p_ += n;
+        if (n < s.size() && p_ > begin_)
+            p_[-1] = '~';
+    }
+    void put(const char* s) { put(std::string_view(s)); }
+    void put(char c) { put(std::string_view(&c, 1)); }
+    void put(bool b) { put(b ? "true" : "false"); }
+
+    template <typename T>
+    std::enable_if_t<std::is_integral_v<T>> put(T v) {
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof buf, v);
+        put(std::string_view(buf, static_cast<std::size_t>(r.ptr - buf)));
+    }
+
+    template <typename T>
+    std::enable_if_t<std::is_floating_point_v<T>> put(T v) {
+        char buf[32];
+        const int n = std::snprintf(buf, sizeof buf, "%g", static_cast<double>(v));
+        put(std::string_view(buf, static_cast<std::size_t>(std::max(n, 0))));
+    }
+
+    template <typename T>
+    void put(const std::vector<T>& v) {
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            if (i)
+                put(',');
+            put(v[i]);
+        }
+    }
+
+    template <typename T>
+    void put(const LogField<T>& f) {
+        put(' ');
+        put(f.key);
+        put('=');
+        put(f.value);
+    }
+
+   private:
+    char* p_;
+    char* begin_;
+    char* end_;
+};
+
+/// Asynchronous logger: per-thread lock-free rings drained by one writer thread
+/// - each thread formats into its own single-producer ring; the hot path is a
+///   level check, the formatting into a fixed buffer and one release store
+/// - a full ring drops the record (counted in stats().dropped) rather than
+///   block a request thread
+/// - the writer wakes every kFlushInterval, writes debug/info to stdout and
+///   warn/error to stderr in one fwrite per batch, then flushes
+/// - lines from different threads are ordered per thread only
+/// - level filtering: TP_LOG_MIN_LEVEL at compile time, set_level() at runtime
+class Log
+{
+   public:
+    static constexpr std::size_t kRecordBytes   = 256;
+    static constexpr std::size_t kRingRecords   = 256; // 每個 thread 64 KiB
+    static constexpr auto        kFlushInterval = std::chrono::milliseconds(20);
+
+    struct Stats
+    {
+        std::uint64_t written;
+        std::uint64_t dropped;    // ring 滿
+        std::uint64_t suppressed; // 取樣略過
+        std::size_t   threads;
+    };
+
+    static constexpr bool compiled(LogLevel lv) {
+        return static_cast<int>(lv) >= TP_LOG_MIN_LEVEL;
+    }
+    static bool enabled(LogLevel lv) {
+        return compiled(lv) &&
+               static_cast<int>(lv) >= level_ref().load(std::memory_order_relaxed);
+    }
+    static void set_level(LogLevel lv) {
+        level_ref().store(static_cast<int>(lv), std::memory_order_relaxed);
+    }
+
+    template <typename... Fields>
+    static void write(LogLevel lv, std::string_view msg, const Fields&... fields) {
+        write_sampled(lv, 0, msg, fields...);
+    }
+
+    // skipped：同一個呼叫點上次輸出後被取樣略過的筆數
+    template <typename... Fields>
+    static void write_sampled(LogLevel         lv,
+                              std::uint64_t    skipped,
+                              std::string_view msg,
+                              const Fields&... fields) {
+        Ring&       ring = local_ring();
+        std::size_t tail = ring.tail.load(std::memory_order_relaxed);
+        if (tail - ring.head.load(std::memory_order_acquire) >= kRingRecords) {
+            instance().dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Record& r = ring.records[tail & (kRingRecords - 1)];
+        r.level   = lv;
+        r.nanos   = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::system_clock::now().time_since_epoch())
+                      .count();
+        LogLine line(r.text, sizeof r.text);
+        line.put(msg);
+        (line.put(fields), ...);
+        if (skipped)
+            line.put(log_kv("suppressed", skipped));
+        r.len = static_cast<std::uint16_t>(line.size());
+        ring.tail.store(tail + 1, std::memory_order_release);
+    }
+
+    // 把目前所有 ring 寫出（關機前、或測試要立即看到輸出時）
+    static void flush() { instance().drain(); }
+
+    static Stats stats() {
+        Log&  log = instance();
+        Stats st{};
+        st.written    = log.written_.load(std::memory_order_relaxed);
+        st.dropped    = log.dropped_.load(std::memory_order_relaxed);
+        st.suppressed = log.suppressed_.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(log.ringsMu_);
+        st.threads = log.rings_.size();
+        return st;
+    }
+
+    static void count_suppressed(std::uint64_t n) {
+        instance().suppressed_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    ~Log() {
+        {
+            std::lock_guard<std::mutex> lk(wakeMu_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (writer_.joinable())
+            writer_.join();
+        drain();
+    }
+
+   private:
+    struct Record
+    {
+        std::int64_t  nanos;
+        LogLevel      level;
+        std::uint16_t len;
+        char          text[kRecordBytes - 16];
+    };
+
+    struct Ring
+    {
+        alignas(64) std::atomic<std::size_t> head{0}; // writer
+        alignas(64) std::atomic<std::size_t> tail{0}; // 擁有的 thread
+        std::atomic<bool> retired{false};             // thread 已結束
+        Record            records[kRingRecords];
+    };
+
+    // thread 結束時標記 ring，由 writer 寫完後回收
+    struct Holder
+    {
+        std::shared_ptr<Ring> ring;
+        ~Holder() {
+            if (ring)
+                ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    std::mutex                         ringsMu_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::mutex                         drainMu_; // 同一時間只有一個消費者
+    std::mutex                         wakeMu_;
+    std::condition_variable            wake_;
+    bool                               stopping_ = false;
+    std::vector<char>                  out_, err_;
+    std::atomic<std::uint64_t>         written_{0};
+    std::atomic<std::uint64_t>         dropped_{0};
+    std::atomic<std::uint64_t>         suppressed_{0};
+    std::thread                        writer_;
+
+    Log() {
+        out_.reserve(64 * 1024);
+        err_.reserve(16 * 1024);
+        writer_ = std::thread([this] {
+            std::unique_lock<std::mutex> lk(wakeMu_);
+            while (!wake_.wait_for(lk, kFlushInterval, [&] { return stopping_; })) {
+                lk.unlock();
+                drain();
+                lk.lock();
+            }
+        });
+    }
+
+    static Log& instance() {
+        static Log log;
+        return log;
+    }
+
+    static std::atomic<int>& level_ref() {
+        static std::atomic<int> lv{static_cast<int>(LogLevel::Info)};
+        return lv;
+    }
+
+    static Ring& local_ring() {
+        thread_local Holder h;
+        if (!h.ring) {
+            h.ring = std::make_shared<Ring>();
+            Log&                        log = instance();
+            std::lock_guard<std::mutex> lk(log.ringsMu_);
+            log.rings_.push_back(h.ring);
+        }
+        return *h.ring;
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex>        dlk(drainMu_);
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::lock_guard<std::mutex> lk(ringsMu_);
+            rings = rings_;
+        }
+        std::uint64_t n = 0;
+        for (auto const& ring : rings) {
+            // 先讀 retired：看到 true 時 thread 的最後一筆也已經可見
+            const bool retired = ring->retired.load(std::memory_order_acquire);
+            std::size_t       head = ring->head.load(std::memory_order_relaxed);
+            const std::size_t tail = ring->tail.load(std::memory_order_acquire);
+            for (; head != tail; ++head, ++n)
+                format(ring->records[head & (kRingRecords - 1)]);
+            ring->head.store(head, std::memory_order_release);
+            if (retired) {
+                std::lock_guard<std::mutex> lk(ringsMu_);
+                rings_.erase(std::remove(rings_.begin(), rings_.end(), ring),
+                             rings_.end());
+            }
+        }
+        if (!out_.empty()) {
+            std::fwrite(out_.data(), 1, out_.size(), stdout);
+            std::fflush(stdout);
+            out_.clear();
+        }
+        if (!err_.empty()) {
+            std::fwrite(err_.data(), 1, err_.size(), stderr);
+            std::fflush(stderr);
+            err_.clear();
+        }
+        written_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // 2026-01-02T03:04:05.678Z [INFO] message key=value
+    void format(const Record& r) {
+        static constexpr const char* kNames[] = {
+            "[DEBUG] ", "[INFO] ", "[WARN] ", "[ERROR] "};
+        auto&             buf  = r.level >= LogLevel::Warn ? err_ : out_;
+        const std::time_t secs = static_cast<std::time_t>(r.nanos / 1000000000);
+        const int         ms   = static_cast<int>(r.nanos / 1000000 % 1000);
+        std::tm           tm{};
+        gmtime_r(&secs, &tm);
+        char      ts[32];
+        const int n = std::snprintf(ts,
+                                    sizeof ts,
+                                    "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ ",
+                                    tm.tm_year + 1900,
+                                    tm.tm_mon + 1,
+                                    tm.tm_mday,
+                                    tm.tm_hour,
+                                    tm.tm_min,
+                                    tm.tm_sec,
+                                    ms);
+        buf.insert(buf.end(), ts, ts + std::max(n, 0));
+        const char* name = kNames[std::min(static_cast<int>(r.level), 3)];
+        buf.insert(buf.end(), name, name + std::strlen(name));
+        buf.insert(buf.end(), r.text, r.text + r.len);
+        buf.push_back('\n');
+    }
+};
+
+/// Per-call-site sampler for hot-path logs: at most perSec lines per second
+/// - one window start + one counter, both relaxed atomics
+/// - lines over the budget are counted and reported as suppressed=N on the
+///   next line that gets through
+class LogSampler
+{
+   public:
+    explicit LogSampler(std::uint32_t perSec) : perSec_(std::max(1u, perSec)) {}
+
+    // true = 這次輸出；skipped 帶回上次輸出後被略過的筆數
+    bool allow(std::uint64_t& skipped) {
+        using namespace std::chrono;
+        const std::int64_t now =
+            duration_cast<seconds>(steady_clock::now().time_since_epoch()).count();
+        std::int64_t win = window_.load(std::memory_order_relaxed);
+        if (now != win && window_.compare_exchange_strong(
+                              win, now, std::memory_order_relaxed))
+            count_.store(0, std::memory_order_relaxed);
+        if (count_.fetch_add(1, std::memory_order_relaxed) >= perSec_) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            Log::count_suppressed(1);
+            return false;
+        }
+        skipped = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+   private:
+    std::uint32_t              perSec_;
+    std::atomic<std::int64_t>  window_{0};
+    std::atomic<std::uint32_t> count_{0};
+    std::atomic<std::uint64_t> suppressed_{0};
+};
+
+// 參數只在等級開啟時才求值；低於 TP_LOG_MIN_LEVEL 時整段是 dead code
+#define TP_LOG(level, ...)                  \
+    do {                                    \
+        if (Log::enabled(level))            \
+            Log::write(level, __VA_ARGS__); \
+    } while (0)
+
+#define TP_LOG_DEBUG(...) TP_LOG(LogLevel::Debug, __VA_ARGS__)
+#define TP_LOG_INFO(...) TP_LOG(LogLevel::Info, __VA_ARGS__)
+#define TP_LOG_WARN(...) TP_LOG(LogLevel::Warn, __VA_ARGS__)
+#define TP_LOG_ERROR(...) TP_LOG(LogLevel::Error, __VA_ARGS__)
+
+// 熱路徑用：每個呼叫點每秒最多 perSec 筆
+#define TP_LOG_SAMPLED(level, perSec, ...)                               \
+    do {                                                                 \
+        if (Log::enabled(level)) {                                       \
+            static LogSampler tp_log_sampler_(perSec);                   \
+            std::uint64_t     tp_log_skipped_ = 0;                       \
+            if (tp_log_sampler_.allow(tp_log_skipped_))                  \
+                Log::write_sampled(level, tp_log_skipped_, __VA_ARGS__); \
+        }                                                                \
+    } while (0)
@@ -0,0 +1,232 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "histogram.hpp"
+
+/// Log-linear latency histogram striped per thread (HDR-style buckets)
+/// - each power of two of microseconds is split into kSub linear sub-buckets,
+///   so a bucket is at most 25% wide; values 0..3 µs get a bucket each and
+///   everything above kMaxMicros (~67 s) lands in the last bucket
+/// - record() touches only the calling thread's stripe: three relaxed adds
+///   (bucket, sum, status class) on cache lines no other thread writes as long
+///   as there are at most kStripes threads
+/// - snapshot() sums the stripes; it may be slightly torn against concurrent
+///   record() calls, which is fine for monitoring
+class HdrHistogram
+{
+   public:
+    static constexpr int           kSubBits   = 2;
+    static constexpr std::uint64_t kSub       = 1u << kSubBits;
+    static constexpr int           kOctaves   = 26;
+    static constexpr std::uint64_t kMaxMicros = (std::uint64_t{1} << kOctaves) - 1;
+    static constexpr std::size_t   kBuckets   = (kOctaves - kSubBits + 1) * kSub;
+    static constexpr std::size_t   kStripes   = 16;
+    static constexpr std::size_t   kClasses   = 6; // 1xx..5xx + 其他
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, kBuckets> counts{};
+        std::array<std::uint64_t, kClasses> classes{}; // 依 HTTP 狀態碼百位數
+        std::uint64_t                       count     = 0;
+        std::uint64_t                       sumMicros = 0;
+
+        /// Upper bound (seconds) of the bucket holding quantile q
+        double quantile_sec(double q) const {
+            if (count == 0)
+                return 0.0;
+            const auto    rank = static_cast<std::uint64_t>(q * (count - 1)) + 1;
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < kBuckets; ++i) {
+                seen += counts[i];
+                if (seen >= rank)
+                    return static_cast<double>(upper_micros(i)) / 1e6;
+            }
+            return static_cast<double>(kMaxMicros) / 1e6;
+        }
+    };
+
+    /// Lower bound of bucket i in µs; bucket i holds [lower(i), lower(i + 1))
+    static std::uint64_t lower_micros(std::size_t i) {
+        if (i < kSub)
+            return i;
+        const std::size_t m = i / kSub;
+        return (kSub + i % kSub) << (m - 1);
+    }
+    static std::uint64_t upper_micros(std::size_t i) { return lower_micros(i + 1); }
+
+    template <typename Rep, typename Period>
+    void record(const std::chrono::duration<Rep, Period>& d, int status = 200) {
+        const auto us =
+            std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        const std::uint64_t v  = us > 0 ? static_cast<std::uint64_t>(us) : 0;
+        Stripe&             st = stripes_[stripe_index()];
+        st.counts[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        st.sumMicros.fetch_add(v, std::memory_order_relaxed);
+        const bool        known = status >= 100 && status < 600;
+        const std::size_t cls   = known ? static_cast<std::size_t>(status / 100) : 0;
+        st.classes[cls].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        for (auto const& st : stripes_) {
+            for (std::size_t i = 0; i < kBuckets; ++i) {
+                const auto n = st.counts[i].load(std::memory_order_relaxed);
+                s.counts[i] += n;
+                s.count += n;
+            }
+            for (std::size_t i = 0; i < kClasses; ++i)
+                s.classes[i] += st.classes[i].load(std::memory_order_relaxed);
+            s.sumMicros += st.sumMicros.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+   private:
+    struct alignas(64) Stripe
+    {
+        std::array<std::atomic<std::uint64_t>, kBuckets> counts{};
+        std::array<std::atomic<std::uint64_t>, kClasses> classes{};
+        std::atomic<std::uint64_t>                       sumMicros{0};
+    };
+
+    std::array<Stripe, kStripes> stripes_{};
+
+    static std::size_t bucket_of(std::uint64_t us) {
+        if (us < kSub)
+            return static_cast<std::size_t>(us);
+        if (us > kMaxMicros)
+            us = kMaxMicros;
+        const int shift = 63 - __builtin_clzll(us) - kSubBits;
+        return static_cast<std::size_t>((shift + 1) * kSub +
+                                        ((us >> shift) & (kSub - 1)));
+    }
+
+    // 每個 thread 第一次記錄時輪流分到一個 stripe
+    static std::size_t stripe_index() {
+        static std::atomic<std::size_t> next{0};
+        thread_local const std::size_t  idx =
+            next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+        return idx;
+    }
+};
+
+/// Prometheus text exposition (format 0.0.4) helpers
+/// - labels are passed pre-rendered, e.g. `route="/api/suggest"`; label values
+///   go through prom::label() for escaping
+/// - histograms use power-of-two µs boundaries (`le` in seconds), the same
+///   boundaries /health/db reports
+namespace prom {
+
+    inline void family(std::string&     out,
+                       std::string_view name,
+                       std::string_view type,
+                       std::string_view help) {
+        out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+
+    inline std::string label(std::string_view key, std::string_view value) {
+        std::string s(key);
+        s += "=\"";
+        for (char c : value) {
+            if (c == '\\' || c == '"' || c == '\n')
+                s += '\\';
+            s += c == '\n' ? 'n' : c;
+        }
+        s += '"';
+        return s;
+    }
+
+    inline void sample(std::string&     out,
+                       std::string_view name,
+                       std::string_view labels,
+                       double           v) {
+        char      buf[32];
+        const int n = std::snprintf(buf, sizeof buf, "%.9g", v);
+        out.append(name);
+        if (!labels.empty())
+            out.append("{").append(labels).append("}");
+        out.append(" ").append(buf, n > 0 ? static_cast<std::size_t>(n) : 0);
+        out.append("\n");
+    }
+
+    template <typename T>
+    std::enable_if_t<std::is_integral_v<T>> sample(std::string&     out,
+                                                   std::string_view name,
+                                                   std::string_view labels,
+                                                   T                v) {
+        out.append(name);
+        if (!labels.empty())
+            out.append("{").append(labels).append("}");
+        out.append(" ").append(std::to_string(v)).append("\n");
+    }
+
+    namespace detail {
+        inline void bucket(std::string&     out,
+                           std::string_view name,
+                           std::string_view labels,
+                           std::string_view le,
+                           std::uint64_t    cumulative) {
+            std::string l(labels);
+            if (!l.empty())
+                l += ',';
+            l.append("le=\"").append(le).append("\"");
+            sample(out, std::string(name) + "_bucket", l, cumulative);
+        }
+
+        inline std::string seconds(std::uint64_t micros) {
+            char      buf[32];
+            const int n = std::snprintf(
+                buf, sizeof buf, "%.9g", static_cast<double>(micros) / 1e6);
+            return std::string(buf, n > 0 ? static_cast<std::size_t>(n) : 0);
+        }
+
+        inline void totals(std::string&     out,
+                           std::string_view name,
+                           std::string_view labels,
+                           std::uint64_t    count,
+                           std::uint64_t    sumMicros) {
+            sample(out, std::string(name) + "_sum", labels, sumMicros / 1e6);
+            sample(out, std::string(name) + "_count", labels, count);
+        }
+    } // namespace detail
+
+    inline void histogram(std::string&                      out,
+                          std::string_view                  name,
+                          std::string_view                  labels,
+                          const LatencyHistogram::Snapshot& s) {
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i + 1 < LatencyHistogram::kBuckets; ++i) {
+            cumulative += s.counts[i];
+            const std::uint64_t up = std::uint64_t{1} << i;
+            detail::bucket(out, name, labels, detail::seconds(up), cumulative);
+        }
+        detail::bucket(out, name, labels, "+Inf", s.count);
+        detail::totals(out, name, labels, s.count, s.sumMicros);
+    }
+
+    inline void histogram(std::string&                  out,
+                          std::string_view              name,
+                          std::string_view              labels,
+                          const HdrHistogram::Snapshot& s) {
+        // 只在 2 的冪次邊界輸出（細的 sub-bucket 用在 quantile）
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i + 1 < HdrHistogram::kBuckets; ++i) {
+            cumulative += s.counts[i];
+            const std::uint64_t up = HdrHistogram::upper_micros(i);
+            if ((up & (up - 1)) == 0)
+                detail::bucket(out, name, labels, detail::seconds(up), cumulative);
+        }
+        detail::bucket(out, name, labels, "+Inf", s.count);
+        detail::totals(out, name, labels, s.count, s.sumMicros);
+    }
+
+} // namespace prom
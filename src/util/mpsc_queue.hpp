@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/// Bounded lock-free multi-producer / single-consumer queue (Vyukov ring)
+/// - capacity is rounded up to a power of two
+/// - try_push never blocks; returns false when full (caller decides backpressure)
+/// - try_pop must only be called from one consumer thread
+/// - try_reserve(n) claims room for n items up front (all or nothing); the
+///   producer then pushes them with push_reserved, which cannot fail. Together
+///   with cancel_reservation this lets one logical message span several queues
+template <typename T>
+class BoundedMpscQueue
+{
+   public:
+    explicit BoundedMpscQueue(std::size_t capacity) {
+        std::size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        mask_  = cap - 1;
+        cells_ = std::make_unique<Cell[]>(cap);
+        for (std::size_t i = 0; i < cap; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedMpscQueue(const BoundedMpscQueue&)            = delete;
+    BoundedMpscQueue& operator=(const BoundedMpscQueue&) = delete;
+
+    bool try_push(const T& v) {
+        if (!try_reserve(1))
+            return false; // full
+        push_reserved(v);
+        return true;
+    }
+
+    /// Claim room for n pushes; false (nothing claimed) when they do not fit
+    bool try_reserve(std::size_t n) {
+        std::size_t cur = reserved_.load(std::memory_order_relaxed);
+        do {
+            if (n > capacity() - cur)
+                return false;
+        } while (!reserved_.compare_exchange_weak(
+            cur, cur + n, std::memory_order_acq_rel, std::memory_order_relaxed));
+        return true;
+    }
+
+    void cancel_reservation(std::size_t n) {
+        reserved_.fetch_sub(n, std::memory_order_release);
+    }
+
+    /// Push one item covered by an earlier try_reserve
+    void push_reserved(const T& v) {
+        Cell*       c;
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            c                 = &cells_[pos & mask_];
+            std::size_t   seq = c->seq.load(std::memory_order_acquire);
+            std::intptr_t dif =
+                static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0) {
+                // 有保留就一定有空位：consumer 已讓出，只是還沒看到
+                std::this_thread::yield();
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+            else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = v;
+        c->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    bool try_pop(T& out) {
+        const std::size_t pos = head_.load(std::memory_order_relaxed);
+        Cell*             c   = &cells_[pos & mask_];
+        const std::size_t seq = c->seq.load(std::memory_order_acquire);
+        if (seq != pos + 1)
+            return false; // empty (or producer still writing this cell)
+        out = c->data;
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_relaxed);
+        reserved_.fetch_sub(1, std::memory_order_release); // 讓出空位
+        return true;
+    }
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    /// Approximate number of queued items (for metrics only)
+    std::size_t size_approx() const {
+        const std::size_t t = tail_.load(std::memory_order_relaxed);
+        const std::size_t h = head_.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+   private:
+    struct Cell
+    {
+        std::atomic<std::size_t> seq{0};
+        T                        data{};
+    };
+
+    std::unique_ptr<Cell[]>              cells_;
+    std::size_t                          mask_ = 0;
+    alignas(64) std::atomic<std::size_t> tail_{0}; // producers
+    alignas(64) std::atomic<std::size_t> head_{0}; // consumer
+    alignas(64) std::atomic<std::size_t> reserved_{0}; // 已保留（含佇列中）的數量
+};
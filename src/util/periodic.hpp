@@ -0,0 +1,58 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/// Background thread that runs a callback at a fixed interval
+/// - start(interval, fn) spawns the thread; the first run happens after one interval
+/// - stop() wakes the thread immediately and joins it (also done by the destructor)
+/// - fn must not throw; callers wrap their own try/catch and log
+class PeriodicWorker
+{
+   public:
+    PeriodicWorker() = default;
+    ~PeriodicWorker() { stop(); }
+
+    PeriodicWorker(const PeriodicWorker&)            = delete;
+    PeriodicWorker& operator=(const PeriodicWorker&) = delete;
+
+    template <typename Rep, typename Period>
+    void start(const std::chrono::duration<Rep, Period>& interval,
+               std::function<void()>                     fn) {
+        stop();
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stopping_ = false;
+        }
+        auto every = std::chrono::duration_cast<std::chrono::milliseconds>(interval);
+        thread_    = std::thread([this, every, fn = std::move(fn)] {
+            std::unique_lock<std::mutex> lk(m_);
+            while (!cv_.wait_for(lk, every, [&] { return stopping_; })) {
+                lk.unlock();
+                fn();
+                lk.lock();
+            }
+        });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    bool running() const { return thread_.joinable(); }
+
+   private:
+    std::mutex              m_;
+    std::condition_variable cv_;
+    bool                    stopping_ = false;
+    std::thread             thread_;
+};
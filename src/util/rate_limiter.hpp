@@ -0,0 +1,194 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string_view>
+
+/// Fixed-size, lock-free token-bucket table (GCRA form): `limit` requests per
+/// `period`, bursts up to `limit`
+/// - one 64-bit word per key: 24-bit key fingerprint + 40-bit theoretical
+///   arrival time (ms since construction); every update is a single CAS
+/// - a key probes kProbe neighbouring slots; a slot whose arrival time has
+///   passed holds a full bucket, so it is free to reuse (TTL eviction without
+///   a sweeper) and an empty slot (word 0) is just an expired one
+/// - when every probed slot is live, the one closest to expiring is taken
+///   over; memory never grows past slots * 8 bytes
+/// - keys are hashed with a per-instance seed; two keys that share a slot
+///   fingerprint share a bucket, which only ever makes the limit stricter
+class RateLimiter
+{
+   public:
+    static constexpr std::size_t kProbe = 8;
+
+    struct Decision
+    {
+        bool          allowed;
+        std::uint32_t remaining;    // 這次之後還能送幾次
+        std::uint32_t retryAfterMs; // 被擋時多久後可重試
+    };
+
+    struct Stats
+    {
+        std::uint64_t allowed;
+        std::uint64_t rejected;
+        std::uint64_t evictions; // 仍在計數中的 key 被擠掉
+        std::size_t   slots;
+    };
+
+    RateLimiter(std::uint32_t             limit,
+                std::chrono::milliseconds period,
+                std::size_t               slots = 65536)
+        : limit_(std::max<std::uint32_t>(1, limit)),
+          period_(std::max<std::uint64_t>(1, period.count())),
+          interval_(std::max<std::uint64_t>(1, period_ / limit_)),
+          mask_(round_up_pow2(std::max(slots, kProbe)) - 1),
+          table_(new std::atomic<std::uint64_t>[mask_ + 1]),
+          seed_(std::random_device{}()),
+          epoch_(std::chrono::steady_clock::now()) {
+        for (std::size_t i = 0; i <= mask_; ++i)
+            table_[i].store(0, std::memory_order_relaxed);
+    }
+
+    RateLimiter(const RateLimiter&)            = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    Decision acquire(std::string_view key) { return acquire(key, now_ms()); }
+
+    // nowMs：建構後經過的毫秒（測試可直接帶入）
+    Decision acquire(std::string_view key, std::uint64_t nowMs) {
+        const std::uint64_t h  = mix(std::hash<std::string_view>{}(key) ^ seed_);
+        const std::uint64_t fp = h >> kTimeBits;
+        const std::size_t   at = static_cast<std::size_t>(h) & mask_;
+
+        for (;;) {
+            // 探測：自己的 slot > 第一個過期的 slot > 最快到期的 slot
+            std::size_t   pos = kNone, expired = kNone, victim = at;
+            std::uint64_t cur = 0, expiredW = 0, victimW = 0;
+            std::uint64_t victimTat = ~std::uint64_t{0};
+            for (std::size_t i = 0; i < kProbe; ++i) {
+                const std::size_t   p   = (at + i) & mask_;
+                const std::uint64_t w   = table_[p].load(std::memory_order_acquire);
+                const std::uint64_t tat = w & kTimeMask;
+                if ((w >> kTimeBits) == fp) {
+                    pos = p;
+                    cur = w;
+                    break;
+                }
+                if (tat <= nowMs) {
+                    if (expired == kNone) {
+                        expired  = p;
+                        expiredW = w;
+                    }
+                }
+                else if (tat < victimTat) {
+                    victimTat = tat;
+                    victim    = p;
+                    victimW   = w;
+                }
+            }
+            if (pos == kNone) {
+                pos = expired != kNone ? expired : victim;
+                cur = expired != kNone ? expiredW : victimW;
+            }
+
+            for (;;) {
+                // 別的 key 的 slot（過期或被擠掉）：從滿桶開始算
+                const bool          own   = (cur >> kTimeBits) == fp;
+                const std::uint64_t tat   = own ? (cur & kTimeMask) : 0;
+                const bool          evict = !own && (cur & kTimeMask) > nowMs;
+                const Decision      d     = decide(tat, nowMs);
+                if (!d.allowed)
+                    return count(d); // 被擋不寫回
+                const std::uint64_t next = pack(fp, next_tat(tat, nowMs));
+                if (table_[pos].compare_exchange_weak(cur,
+                                                      next,
+                                                      std::memory_order_acq_rel,
+                                                      std::memory_order_acquire)) {
+                    if (evict)
+                        evictions_.fetch_add(1, std::memory_order_relaxed);
+                    return count(d);
+                }
+                if ((cur >> kTimeBits) != fp)
+                    break; // slot 剛被別的 key 拿走：重新探測
+            }
+        }
+    }
+
+    Stats stats() const {
+        Stats st{};
+        st.allowed   = allowed_.load(std::memory_order_relaxed);
+        st.rejected  = rejected_.load(std::memory_order_relaxed);
+        st.evictions = evictions_.load(std::memory_order_relaxed);
+        st.slots     = mask_ + 1;
+        return st;
+    }
+
+    std::uint32_t limit() const { return limit_; }
+    std::uint64_t period_ms() const { return period_; }
+
+   private:
+    static constexpr int           kTimeBits = 40; // 毫秒，約 34 年
+    static constexpr std::uint64_t kTimeMask = (std::uint64_t{1} << kTimeBits) - 1;
+    static constexpr std::size_t   kNone     = ~std::size_t{0};
+
+    std::uint32_t                                 limit_;
+    std::uint64_t                                 period_;   // ms
+    std::uint64_t                                 interval_; // 補一個 token 的間隔
+    std::size_t                                   mask_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> table_;
+    std::uint64_t                                 seed_;
+    std::chrono::steady_clock::time_point         epoch_;
+
+    std::atomic<std::uint64_t> allowed_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+
+    std::uint64_t now_ms() const {
+        using namespace std::chrono;
+        // +1：讓 0（空 slot）永遠算過期
+        return static_cast<std::uint64_t>(
+                   duration_cast<milliseconds>(steady_clock::now() - epoch_)
+                       .count()) +
+               1;
+    }
+
+    // GCRA：tat 往後推一個 interval，超過 period 的容許量就擋
+    Decision decide(std::uint64_t tat, std::uint64_t nowMs) const {
+        const std::uint64_t next = next_tat(tat, nowMs);
+        const std::uint64_t used = next - nowMs;
+        if (used > period_)
+            return {false, 0, static_cast<std::uint32_t>(used - period_)};
+        return {true, static_cast<std::uint32_t>((period_ - used) / interval_), 0};
+    }
+
+    std::uint64_t next_tat(std::uint64_t tat, std::uint64_t nowMs) const {
+        return std::max(tat, nowMs) + interval_;
+    }
+
+    Decision count(const Decision& d) {
+        (d.allowed ? allowed_ : rejected_).fetch_add(1, std::memory_order_relaxed);
+        return d;
+    }
+
+    static std::uint64_t pack(std::uint64_t fp, std::uint64_t tat) {
+        return (fp << kTimeBits) | (tat & kTimeMask);
+    }
+
+    // splitmix64 finalizer：讓 fingerprint（高位）與 slot（低位）都均勻
+    static std::uint64_t mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static std::size_t round_up_pow2(std::size_t n) {
+        std::size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+};
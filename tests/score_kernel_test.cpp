@@ -0,0 +1,100 @@
+// AVX2 與 scalar 的 final_score kernel 在隨機輸入上必須一致（容許捨入誤差）
+//
+//   cmake -S . -B build -DTP_BUILD_TESTS=ON && cmake --build build
+//   ctest --test-dir build --output-on-failure
+//
+// 涵蓋：長度 0..67（各種尾巴）與較長的欄位、userMin <= 0、suggested_time <= 0、
+// 預設權重（編譯期常數）與隨機的執行期權重
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "index/score_kernel.hpp"
+
+namespace {
+
+    constexpr int    kSkip      = 77; // ctest SKIP_RETURN_CODE
+    constexpr double kTolerance = 1e-12;
+
+    struct Input
+    {
+        std::vector<double> tagFit, quality, popularity;
+        std::vector<int>    sugTime;
+
+        scoring::Columns columns() const {
+            return {
+                tagFit.data(), sugTime.data(), quality.data(), popularity.data()};
+        }
+    };
+
+    Input random_input(std::mt19937_64& rng, int n) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::uniform_int_distribution<int>     minutes(-5, 240);
+        Input                                  in;
+        for (int i = 0; i < n; ++i) {
+            in.tagFit.push_back(unit(rng));
+            in.quality.push_back(unit(rng));
+            in.popularity.push_back(unit(rng));
+            in.sugTime.push_back(minutes(rng)); // 含 0 與負數（→ 0.8）
+        }
+        return in;
+    }
+
+    template <typename W>
+    int compare(const Input& in, const W& w, int userMin, const char* what) {
+        const int           n = static_cast<int>(in.tagFit.size());
+        std::vector<double> scalar(n), avx2(n);
+        scoring::score_scalar(in.columns(), w, userMin, n, scalar.data());
+        scoring::score_avx2(in.columns(), w, userMin, n, avx2.data());
+        for (int i = 0; i < n; ++i) {
+            const double diff = std::fabs(scalar[i] - avx2[i]);
+            if (!(diff <= kTolerance * std::max(1.0, std::fabs(scalar[i])))) {
+                std::printf("FAIL %s n=%d userMin=%d row=%d: %.17g vs %.17g\n",
+                            what,
+                            n,
+                            userMin,
+                            i,
+                            scalar[i],
+                            avx2[i]);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+} // namespace
+
+int main() {
+#if defined(TP_SCORE_X86)
+    if (!__builtin_cpu_supports("avx2")) {
+        std::printf("SKIP: CPU has no AVX2\n");
+        return kSkip;
+    }
+    std::mt19937_64                        rng(20241017);
+    std::uniform_int_distribution<int>     user(-3, 240);
+    std::uniform_real_distribution<double> weight(0.0, 2.0);
+
+    int failures = 0, cases = 0;
+    for (int round = 0; round < 2000; ++round) {
+        const int   n  = round < 68 ? round : 64 + static_cast<int>(rng() % 4096);
+        const Input in = random_input(rng, n);
+        const int   u  = round % 10 == 0 ? 0 : user(rng); // 0 → time_fit 0.8
+
+        RankingWeights w;
+        w.tag        = weight(rng);
+        w.time       = weight(rng);
+        w.quality    = weight(rng);
+        w.popularity = weight(rng);
+
+        failures += compare(in, DefaultRanking{}, u, "default");
+        failures += compare(in, w, u, "runtime");
+        cases += 2;
+    }
+    std::printf("%d cases, %d failures\n", cases, failures);
+    return failures ? 1 : 0;
+#else
+    std::printf("SKIP: no AVX2 kernel on this architecture\n");
+    return kSkip;
+#endif
+}